@@ -0,0 +1,220 @@
+#include "aggregate.hpp"
+
+#include "logic.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+auto Summary::converted(Conversion const& conversion) const -> Summary {
+  auto result = *this;
+  result.sum = sum * conversion.scale + static_cast<double>(count) *
+                                            conversion.offset;
+  result.min = conversion(min);
+  result.max = conversion(max);
+  result.mean = conversion(mean);
+  result.variance = variance * conversion.scale * conversion.scale;
+  for (auto& [quantile, value] : result.quantiles) {
+    value = conversion(value);
+  }
+  return result;
+}
+
+QuantileEstimator::QuantileEstimator(double const quantile)
+    : m_quantile {quantile},
+      m_desired {1., 1. + 2. * quantile, 1. + 4. * quantile,
+                 3. + 2. * quantile, 5.},
+      m_increments {0., quantile / 2., quantile, (1. + quantile) / 2., 1.} {}
+
+auto QuantileEstimator::add(double const value) -> void {
+  if (m_count < exactCount) {
+    m_values.push_back(value);
+  } else if (!m_values.empty()) {
+    m_values = std::vector<double> {};
+  }
+
+  // The first five values initialize the markers
+  if (m_count < m_heights.size()) {
+    m_heights[m_count++] = value;
+    if (m_count == m_heights.size()) {
+      std::sort(m_heights.begin(), m_heights.end());
+    }
+    return;
+  }
+  ++m_count;
+
+  // Find the cell the value falls in, extending the extreme markers if needed
+  auto cell = std::size_t {};
+  if (value < m_heights[0]) {
+    m_heights[0] = value;
+  } else if (value >= m_heights[4]) {
+    m_heights[4] = value;
+    cell = 3;
+  } else {
+    while (value >= m_heights[cell + 1]) {
+      ++cell;
+    }
+  }
+
+  for (auto i = cell + 1; i < m_positions.size(); ++i) {
+    m_positions[i] += 1.;
+  }
+  for (auto i = std::size_t {}; i < m_desired.size(); ++i) {
+    m_desired[i] += m_increments[i];
+  }
+
+  // Adjust the middle markers if they're off their desired positions
+  for (auto i = std::size_t {1}; i < 4; ++i) {
+    auto const offset = m_desired[i] - m_positions[i];
+    if ((offset >= 1. && m_positions[i + 1] - m_positions[i] > 1.) ||
+        (offset <= -1. && m_positions[i - 1] - m_positions[i] < -1.)) {
+      auto const d = std::copysign(1., offset);
+      auto const height = parabolic(i, d);
+      if (m_heights[i - 1] < height && height < m_heights[i + 1]) {
+        m_heights[i] = height;
+      } else {
+        m_heights[i] = linear(i, d);
+      }
+      m_positions[i] += d;
+    }
+  }
+}
+
+auto QuantileEstimator::parabolic(std::size_t const i, double const d) const
+    -> double {
+  auto const& q = m_heights;
+  auto const& n = m_positions;
+  return q[i] + d / (n[i + 1] - n[i - 1]) *
+                    ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) /
+                         (n[i + 1] - n[i]) +
+                     (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) /
+                         (n[i] - n[i - 1]));
+}
+
+auto QuantileEstimator::linear(std::size_t const i, double const d) const
+    -> double {
+  auto const j = d > 0. ? i + 1 : i - 1;
+  return m_heights[i] + d * (m_heights[j] - m_heights[i]) /
+                            (m_positions[j] - m_positions[i]);
+}
+
+auto QuantileEstimator::value() const -> double {
+  if (m_count == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (m_count > exactCount) {
+    return m_heights[2];
+  }
+  auto values = m_values;
+  auto const rank = static_cast<std::size_t>(
+      std::ceil(m_quantile * static_cast<double>(m_count)));
+  auto const nth = values.begin() + static_cast<std::ptrdiff_t>(
+                                        std::max(rank, std::size_t {1}) - 1);
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+Aggregate::Aggregate(std::vector<double> const& quantiles)
+    : m_estimators(quantiles.cbegin(), quantiles.cend()) {}
+
+auto Aggregate::flush() -> void {
+  auto const size = m_blockSize;
+  m_blockSize = 0;
+  if (size == 0) {
+    return;
+  }
+  auto const* const block = m_block.data();
+
+  // Independent lanes let the compiler vectorize the reductions without
+  // reordering floating point operations.
+  auto mins = std::array<double, lanes> {};
+  auto maxs = std::array<double, lanes> {};
+  auto sums = std::array<double, lanes> {};
+  auto compensations = std::array<double, lanes> {};
+  mins.fill(block[0]);
+  maxs.fill(block[0]);
+
+  auto const vectorSize = size - size % lanes;
+  for (auto i = std::size_t {}; i < vectorSize; i += lanes) {
+    for (auto lane = std::size_t {}; lane < lanes; ++lane) {
+      auto const value = block[i + lane];
+      mins[lane] = std::min(mins[lane], value);
+      maxs[lane] = std::max(maxs[lane], value);
+      // Kahan summation per lane
+      auto const y = value - compensations[lane];
+      auto const t = sums[lane] + y;
+      compensations[lane] = (t - sums[lane]) - y;
+      sums[lane] = t;
+    }
+  }
+  for (auto i = vectorSize; i < size; ++i) {
+    mins[0] = std::min(mins[0], block[i]);
+    maxs[0] = std::max(maxs[0], block[i]);
+    sums[0] += block[i];
+  }
+
+  auto blockSum = 0.;
+  for (auto lane = std::size_t {}; lane < lanes; ++lane) {
+    blockSum += sums[lane] - compensations[lane];
+    // Neumaier summation into the running total
+    auto const t = m_sum + sums[lane];
+    if (std::abs(m_sum) >= std::abs(sums[lane])) {
+      m_compensation += (m_sum - t) + sums[lane];
+    } else {
+      m_compensation += (sums[lane] - t) + m_sum;
+    }
+    m_sum = t;
+    m_compensation -= compensations[lane];
+  }
+
+  auto const blockMin = *std::min_element(mins.cbegin(), mins.cend());
+  auto const blockMax = *std::max_element(maxs.cbegin(), maxs.cend());
+  m_min = m_count == 0 ? blockMin : std::min(m_min, blockMin);
+  m_max = m_count == 0 ? blockMax : std::max(m_max, blockMax);
+
+  // Combine the block's mean and squared differences with the running ones
+  // (Chan et al.) which is more accurate than a running sum of squares.
+  auto const blockCount = static_cast<double>(size);
+  auto const blockMean = blockSum / blockCount;
+  auto blockM2 = 0.;
+  for (auto i = std::size_t {}; i < size; ++i) {
+    auto const difference = block[i] - blockMean;
+    blockM2 += difference * difference;
+  }
+  auto const count = static_cast<double>(m_count);
+  auto const total = count + blockCount;
+  auto const delta = blockMean - m_mean;
+  m_mean += delta * blockCount / total;
+  m_m2 += blockM2 + delta * delta * count * blockCount / total;
+  m_count += size;
+
+  for (auto& estimator : m_estimators) {
+    for (auto i = std::size_t {}; i < size; ++i) {
+      estimator.add(block[i]);
+    }
+  }
+}
+
+auto Aggregate::summary() -> Summary {
+  flush();
+
+  auto result = Summary {};
+  result.count = m_count;
+  for (auto const& estimator : m_estimators) {
+    result.quantiles.emplace_back(estimator.quantile(), estimator.value());
+  }
+  if (m_count == 0) {
+    auto const nan = std::numeric_limits<double>::quiet_NaN();
+    result.min = result.max = result.mean = result.variance = nan;
+    return result;
+  }
+  result.sum = m_sum + m_compensation;
+  result.min = m_min;
+  result.max = m_max;
+  result.mean = m_mean;
+  result.variance = m_m2 / static_cast<double>(m_count);
+  return result;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Statistics of a sequence of values
+struct Summary {
+  std::size_t count {};
+  double sum {};
+  double min {};
+  double max {};
+  double mean {};
+  // Population variance
+  double variance {};
+  // (quantile, estimated value) pairs, e.g. (0.5, median)
+  std::vector<std::pair<double, double>> quantiles;
+
+  // Statistics of the same values after they're converted with conversion.
+  // Every conversion is affine and increasing, so the statistics can be
+  // converted directly instead of converting every value.
+  [[nodiscard]] auto converted(Conversion const& conversion) const -> Summary;
+};
+
+// Estimates a quantile in constant memory using the P² algorithm (Jain and
+// Chlamtac, 1985). P² needs many values to converge, so the quantile of the
+// first exactCount values is computed exactly by nearest rank instead.
+class QuantileEstimator {
+public:
+  explicit QuantileEstimator(double quantile);
+
+  auto add(double value) -> void;
+
+  [[nodiscard]] auto quantile() const noexcept -> double { return m_quantile; }
+  [[nodiscard]] auto value() const -> double;
+
+private:
+  static std::size_t constexpr exactCount = 512;
+
+  [[nodiscard]] auto parabolic(std::size_t i, double d) const -> double;
+  [[nodiscard]] auto linear(std::size_t i, double d) const -> double;
+
+  double m_quantile;
+  std::size_t m_count {};
+  std::array<double, 5> m_heights {};
+  std::array<double, 5> m_positions {1., 2., 3., 4., 5.};
+  std::array<double, 5> m_desired {};
+  std::array<double, 5> m_increments {};
+  // Every value until there are more than exactCount
+  std::vector<double> m_values;
+};
+
+// Computes a Summary of a stream of values in constant memory. Values are
+// buffered in fixed size blocks so that the reductions run over contiguous
+// arrays the compiler can vectorize.
+class Aggregate {
+public:
+  explicit Aggregate(std::vector<double> const& quantiles);
+
+  auto add(double const value) -> void {
+    m_block[m_blockSize++] = value;
+    if (m_blockSize == m_block.size()) {
+      flush();
+    }
+  }
+
+  [[nodiscard]] auto summary() -> Summary;
+
+private:
+  static std::size_t constexpr lanes = 4;
+
+  auto flush() -> void;
+
+  std::array<double, 1024> m_block {};
+  std::size_t m_blockSize {};
+
+  std::size_t m_count {};
+  // Neumaier compensated sum
+  double m_sum {};
+  double m_compensation {};
+  double m_min {};
+  double m_max {};
+  double m_mean {};
+  // Sum of squared differences from the mean
+  double m_m2 {};
+  std::vector<QuantileEstimator> m_estimators;
+};
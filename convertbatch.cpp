@@ -0,0 +1,127 @@
+#include "convertbatch.hpp"
+
+#include "kernels.hpp"
+#include "logic.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+static_assert(sizeof(UnitPair) == 4,
+              "UnitPair must stay compact enough to store per value");
+
+namespace {
+
+// Bucket of the values whose units are of different types
+std::size_t constexpr mismatchedBucket = impl::pair_count;
+static_assert(mismatchedBucket <= std::numeric_limits<std::uint16_t>::max(),
+              "Buckets must fit in 16 bits");
+
+auto bucket_of(UnitPair const pair) -> std::uint16_t {
+  if (pair.from.typeIndex() != pair.to.typeIndex()) {
+    return static_cast<std::uint16_t>(mismatchedBucket);
+  }
+  return static_cast<std::uint16_t>(impl::pair_index(pair.from, pair.to));
+}
+
+} // namespace
+
+auto BatchConverter::convert(UnitPair const* const pairs,
+                             double const* const values, double* const results,
+                             bool* const converted, std::size_t const count)
+    -> bool {
+  auto allConverted = true;
+  for (auto done = std::size_t {}; done < count; done += blockSize) {
+    auto const size = std::min(count - done, blockSize);
+    allConverted &= convertBlock(pairs + done, values + done, results + done,
+                                 converted ? converted + done : nullptr, size);
+  }
+  return allConverted;
+}
+
+auto BatchConverter::convertBlock(UnitPair const* const pairs,
+                                  double const* const values,
+                                  double* const results, bool* const converted,
+                                  std::size_t const count) -> bool {
+  auto const samePair = [first = pairs[0]](UnitPair const pair) {
+    return pair.from == first.from && pair.to == first.to;
+  };
+  if (std::all_of(pairs, pairs + count, samePair)) {
+    // Every value has the same units, so there's nothing to sort
+    auto const isConverted =
+        pairs[0].from.typeIndex() == pairs[0].to.typeIndex();
+    if (isConverted) {
+      kernel(pairs[0].from, pairs[0].to)->block(values, results, count);
+    } else {
+      std::fill(results, results + count,
+                std::numeric_limits<double>::quiet_NaN());
+    }
+    if (converted) {
+      std::fill(converted, converted + count, isConverted);
+    }
+    return isConverted;
+  }
+
+  m_buckets.resize(count);
+  m_sorted.resize(count);
+  m_positions.resize(count);
+  m_offsets.resize(mismatchedBucket + 1);
+  m_seen.clear();
+
+  for (auto i = std::size_t {}; i < count; ++i) {
+    auto const bucket = bucket_of(pairs[i]);
+    m_buckets[i] = bucket;
+    if (m_offsets[bucket]++ == 0) {
+      m_seen.push_back(bucket);
+    }
+  }
+
+  // Turns the counts into the offsets of the buckets
+  auto offset = std::size_t {};
+  for (auto const bucket : m_seen) {
+    auto const size = m_offsets[bucket];
+    m_offsets[bucket] = offset;
+    offset += size;
+  }
+
+  for (auto i = std::size_t {}; i < count; ++i) {
+    auto const position = m_offsets[m_buckets[i]]++;
+    m_sorted[position] = values[i];
+    m_positions[position] = i;
+  }
+
+  // Each offset is now the end of its bucket
+  auto allConverted = true;
+  auto begin = std::size_t {};
+  for (auto const bucket : m_seen) {
+    auto const end = m_offsets[bucket];
+    m_offsets[bucket] = 0;
+
+    auto const isConverted = bucket != mismatchedBucket;
+    if (isConverted) {
+      auto const& pair = pairs[m_positions[begin]];
+      kernel(pair.from, pair.to)
+          ->block(&m_sorted[begin], &m_sorted[begin], end - begin);
+    } else {
+      allConverted = false;
+    }
+
+    for (auto position = begin; position < end; ++position) {
+      auto const i = m_positions[position];
+      results[i] = isConverted ? m_sorted[position]
+                               : std::numeric_limits<double>::quiet_NaN();
+      if (converted) {
+        converted[i] = isConverted;
+      }
+    }
+    begin = end;
+  }
+  return allConverted;
+}
+
+auto convertBatch(UnitPair const* const pairs, double const* const values,
+                  double* const results, bool* const converted,
+                  std::size_t const count) -> bool {
+  return BatchConverter {}.convert(pairs, values, results, converted, count);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct UnitPair {
+  UnitId from;
+  UnitId to;
+};
+
+// Converts values that each have their own pair of units. Values are bucketed
+// by pair with a counting sort, each bucket is converted by its pair's block
+// kernel (see kernels.hpp) and the results are scattered back in the original
+// order. The buffers are reused between batches, so a BatchConverter should
+// be kept around when converting many batches.
+class BatchConverter {
+public:
+  // Converts values[i] from pairs[i].from to pairs[i].to into results[i].
+  // values and results may be the same array. If the units of pairs[i] are of
+  // different types (e.g. distance and temperature) results[i] is NaN and
+  // converted[i] is false. converted may be null.
+  // returns false if any value wasn't converted
+  auto convert(UnitPair const* pairs, double const* values, double* results,
+               bool* converted, std::size_t count) -> bool;
+
+private:
+  // Number of values sorted at a time. Small enough for the sorted values to
+  // stay in cache until they're scattered back.
+  static std::size_t constexpr blockSize = 4096;
+
+  auto convertBlock(UnitPair const* pairs, double const* values,
+                    double* results, bool* converted, std::size_t count)
+      -> bool;
+
+  // Bucket of each value
+  std::vector<std::uint16_t> m_buckets;
+  // Values sorted by bucket, and where in the batch they came from
+  std::vector<double> m_sorted;
+  std::vector<std::size_t> m_positions;
+  // Buckets in the order they were first seen, so that only those are visited
+  std::vector<std::uint16_t> m_seen;
+  // Per bucket count, then offset while sorting. Zero between batches.
+  std::vector<std::size_t> m_offsets;
+};
+
+// Converts a single batch, see BatchConverter::convert
+auto convertBatch(UnitPair const* pairs, double const* values, double* results,
+                  bool* converted, std::size_t count) -> bool;
@@ -0,0 +1,736 @@
+#include "convertfiles.hpp"
+
+#include "logic.hpp"
+#include "parsenumbers.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define JCONVERTER_HAS_IO_URING 1
+#endif
+
+using std::cerr;
+using std::string;
+using std::string_view;
+namespace fs = std::filesystem;
+
+auto appendRow(string& out, std::vector<Conversion> const& conversions,
+               double const value) -> void {
+  // Formatted like std::ostream's default (%g) formatting
+  auto buffer = std::array<char, 32> {};
+  auto separator = false;
+  for (auto const& conversion : conversions) {
+    if (separator) {
+      out += '\t';
+    }
+    separator = true;
+    auto const [end, error] =
+        std::to_chars(buffer.data(), buffer.data() + buffer.size(),
+                      conversion(value), std::chars_format::general, 6);
+    static_cast<void>(error);
+    out.append(buffer.data(), end);
+  }
+  out += '\n';
+}
+
+namespace {
+
+auto read_file(fs::path const& path) -> std::optional<string> {
+  auto file = std::ifstream {path, std::ios::binary};
+  if (!file) {
+    return std::nullopt;
+  }
+  auto error = std::error_code {};
+  auto const size = fs::file_size(path, error);
+  auto contents = string {};
+  if (!error) {
+    // Read the whole file at once when its size is known
+    contents.resize(size);
+    file.read(contents.data(), static_cast<std::streamsize>(size));
+    contents.resize(static_cast<std::size_t>(file.gcount()));
+  } else {
+    contents.assign(std::istreambuf_iterator<char> {file},
+                    std::istreambuf_iterator<char> {});
+  }
+  return contents;
+}
+
+// returns the invalid value if text contains one
+auto convert_text(string_view const text,
+                  std::vector<Conversion> const& conversions,
+                  NumberFormat const& format, std::vector<double>& values,
+                  string& out) -> std::optional<string_view> {
+  values.clear();
+  auto const parsed = parseNumbers(text, values, format);
+  if (parsed.invalidToken) {
+    return parsed.invalidToken;
+  }
+  // The last value isn't followed by whitespace at the end of the file
+  auto const rest = text.substr(parsed.consumed);
+  if (!rest.empty()) {
+    auto const last = parseNumber(rest, format);
+    if (last.error != std::errc {}) {
+      return rest;
+    }
+    values.push_back(last.value);
+  }
+
+  out.clear();
+  for (auto const value : values) {
+    appendRow(out, conversions, value);
+  }
+  return std::nullopt;
+}
+
+// returns empty optional and reports the error if a directory can't be read
+// or two inputs would be written to the same output file
+auto expand_inputs(std::vector<fs::path> const& inputs)
+    -> std::optional<std::vector<fs::path>> {
+  auto files = std::vector<fs::path> {};
+  for (auto const& input : inputs) {
+    auto error = std::error_code {};
+    if (!fs::is_directory(input, error)) {
+      files.push_back(input);
+      continue;
+    }
+    for (auto const& entry : fs::directory_iterator {input, error}) {
+      if (entry.is_regular_file(error)) {
+        files.push_back(entry.path());
+      }
+    }
+    if (error) {
+      cerr << "[Input] Could not read directory " << input.string() << ".\n";
+      return std::nullopt;
+    }
+  }
+
+  // Outputs are named after the inputs, so inputs with the same name in
+  // different directories would overwrite each other
+  auto outputs = std::map<fs::path, fs::path const*> {};
+  for (auto const& file : files) {
+    auto const [output, inserted] = outputs.emplace(file.filename(), &file);
+    if (!inserted) {
+      cerr << "[Input] " << output->second->string() << " and "
+           << file.string() << " would both be written to "
+           << output->first.string() << ".\n";
+      return std::nullopt;
+    }
+  }
+  return files;
+}
+
+// returns false and reports the error if converting a file would overwrite it,
+// i.e. if it's in the output directory itself
+auto check_outputs(std::vector<fs::path> const& files,
+                   fs::path const& outputDirectory) -> bool {
+  for (auto const& file : files) {
+    auto const output = outputDirectory / file.filename();
+    // Outputs that don't exist yet can't be the input, which is reported as
+    // an error by fs::equivalent
+    auto error = std::error_code {};
+    if (fs::equivalent(file, output, error)) {
+      cerr << "[Input] " << file.string()
+           << " would be overwritten by its converted file.\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// The files being converted, shared by every worker
+struct Batch {
+  std::vector<fs::path> const& files;
+  fs::path const& outputDirectory;
+  std::vector<Conversion> const& conversions;
+  NumberFormat const& format;
+
+  std::atomic<std::size_t> next {};
+  std::atomic<bool> succeeded {true};
+  std::mutex errorMutex {};
+
+  // returns the index of the next file to convert or empty optional if every
+  // file has been handed out
+  auto take() -> std::optional<std::size_t> {
+    auto const i = next++;
+    return i < files.size() ? std::optional {i} : std::nullopt;
+  }
+
+  auto outputPath(std::size_t const i) const -> fs::path {
+    return outputDirectory / files[i].filename();
+  }
+
+  auto reportError(std::size_t const i, string_view const msg) -> void {
+    auto const lock = std::lock_guard {errorMutex};
+    cerr << "[Input] " << files[i].string() << ": " << msg << '\n';
+    succeeded = false;
+  }
+};
+
+auto convert_synchronously(Batch& batch) -> void {
+  // Reused between files so that converting a file doesn't allocate once
+  // the buffers have grown large enough.
+  auto values = std::vector<double> {};
+  auto out = string {};
+
+  while (auto const i = batch.take()) {
+    auto const text = read_file(batch.files[*i]);
+    if (!text) {
+      batch.reportError(*i, "Could not read file.");
+      continue;
+    }
+    if (auto const invalid = convert_text(*text, batch.conversions,
+                                          batch.format, values, out)) {
+      batch.reportError(*i, "Invalid value (" + string {*invalid} + ").");
+      continue;
+    }
+
+    auto file = std::ofstream {batch.outputPath(*i),
+                               std::ios::binary | std::ios::trunc};
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+      batch.reportError(*i, "Could not write converted file.");
+    }
+  }
+}
+
+#ifdef JCONVERTER_HAS_IO_URING
+
+// A minimal io_uring instance driven through the raw system calls, since the
+// tree doesn't depend on liburing.
+class IoUring {
+public:
+  // returns empty optional if the kernel doesn't support io_uring or is too
+  // old for the operations used here, e.g. when it's disabled in a container
+  static auto create(unsigned const entries) -> std::optional<IoUring> {
+    auto params = io_uring_params {};
+    auto const fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    auto ring = IoUring {fd};
+    // Open, statx and close need Linux 5.6, the first version with this
+    // feature
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+      return std::nullopt;
+    }
+
+    ring.m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.m_cqSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto const singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping) {
+      ring.m_sqSize = ring.m_cqSize = std::max(ring.m_sqSize, ring.m_cqSize);
+    }
+    ring.m_sqEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring.m_sq = map(fd, ring.m_sqSize, IORING_OFF_SQ_RING);
+    ring.m_cq = singleMapping ? ring.m_sq
+                              : map(fd, ring.m_cqSize, IORING_OFF_CQ_RING);
+    ring.m_sqEntries = static_cast<io_uring_sqe*>(
+        map(fd, ring.m_sqEntriesSize, IORING_OFF_SQES));
+    if (!ring.m_sq || !ring.m_cq || !ring.m_sqEntries) {
+      return std::nullopt;
+    }
+
+    auto* const sq = static_cast<char*>(ring.m_sq);
+    auto* const cq = static_cast<char*>(ring.m_cq);
+    ring.m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.m_sqCapacity = params.sq_entries;
+    ring.m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.m_cqEntries =
+        reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Submission queue entry i is always at index i of the array
+    auto* const array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (auto i = 0U; i < params.sq_entries; ++i) {
+      array[i] = i;
+    }
+    ring.m_tail = *ring.m_sqTail;
+    return ring;
+  }
+
+  IoUring(IoUring&& other) noexcept { swap(other); }
+
+  auto operator=(IoUring&& other) noexcept -> IoUring& {
+    swap(other);
+    return *this;
+  }
+
+  ~IoUring() {
+    if (m_sqEntries) {
+      munmap(m_sqEntries, m_sqEntriesSize);
+    }
+    if (m_cq && m_cq != m_sq) {
+      munmap(m_cq, m_cqSize);
+    }
+    if (m_sq) {
+      munmap(m_sq, m_sqSize);
+    }
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+  }
+
+  // Queues an operation, which is submitted by the next call to wait
+  // returns false if the queue is full and couldn't be submitted
+  [[nodiscard]] auto push(io_uring_sqe const& entry) -> bool {
+    if (queued() == m_sqCapacity && (!enter(0) || queued() == m_sqCapacity)) {
+      return false;
+    }
+    m_sqEntries[m_tail & m_sqMask] = entry;
+    ++m_tail;
+    __atomic_store_n(m_sqTail, m_tail, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Submits the queued operations and waits until at least one completes.
+  // Calls handler(userData, result) for every completed operation.
+  // returns false if the kernel rejected the submission
+  template <typename Handler>
+  [[nodiscard]] auto wait(Handler&& handler) -> bool {
+    if (!enter(1)) {
+      return false;
+    }
+    reap(handler);
+    return true;
+  }
+
+  // Waits until every submitted operation has completed, without submitting
+  // the queued ones. Calls handler(userData, result) for every completed
+  // operation. The kernel may write to an operation's buffers until it
+  // completes, so this must be called before freeing them if wait failed.
+  template <typename Handler>
+  auto drain(Handler&& handler) -> void {
+    reap(handler);
+    while (m_inFlight > 0) {
+      auto const result =
+          syscall(__NR_io_uring_enter, m_fd, 0U, 1U, IORING_ENTER_GETEVENTS,
+                  nullptr, 0);
+      if (result < 0 && errno != EINTR) {
+        // The operations still complete, only waiting for them failed
+        std::this_thread::sleep_for(std::chrono::milliseconds {1});
+      }
+      reap(handler);
+    }
+  }
+
+private:
+  explicit IoUring(int const fd) : m_fd {fd} {}
+
+  static auto map(int const fd, std::size_t const size, off_t const offset)
+      -> void* {
+    auto* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, offset);
+    return mapping == MAP_FAILED ? nullptr : mapping;
+  }
+
+  template <typename Handler>
+  auto reap(Handler& handler) -> void {
+    auto head = *m_cqHead;
+    auto const tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      auto const& completion = m_cqEntries[head & m_cqMask];
+      auto const userData = completion.user_data;
+      auto const result = completion.res;
+      // Released before handling, which may queue more operations
+      __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+      --m_inFlight;
+      handler(userData, result);
+    }
+  }
+
+  [[nodiscard]] auto queued() const -> unsigned {
+    return m_tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  }
+
+  [[nodiscard]] auto enter(unsigned const minComplete) -> bool {
+    while (true) {
+      auto const result = syscall(
+          __NR_io_uring_enter, m_fd, queued(), minComplete,
+          minComplete > 0 ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+      if (result >= 0) {
+        m_inFlight += static_cast<std::size_t>(result);
+        return true;
+      }
+      if (errno == EAGAIN || errno == EBUSY) {
+        // Anything not submitted yet is submitted by the next call
+        return true;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  auto swap(IoUring& other) noexcept -> void {
+    std::swap(m_fd, other.m_fd);
+    std::swap(m_sq, other.m_sq);
+    std::swap(m_cq, other.m_cq);
+    std::swap(m_sqEntries, other.m_sqEntries);
+    std::swap(m_sqSize, other.m_sqSize);
+    std::swap(m_cqSize, other.m_cqSize);
+    std::swap(m_sqEntriesSize, other.m_sqEntriesSize);
+    std::swap(m_sqHead, other.m_sqHead);
+    std::swap(m_sqTail, other.m_sqTail);
+    std::swap(m_sqMask, other.m_sqMask);
+    std::swap(m_sqCapacity, other.m_sqCapacity);
+    std::swap(m_tail, other.m_tail);
+    std::swap(m_cqHead, other.m_cqHead);
+    std::swap(m_cqTail, other.m_cqTail);
+    std::swap(m_cqMask, other.m_cqMask);
+    std::swap(m_cqEntries, other.m_cqEntries);
+    std::swap(m_inFlight, other.m_inFlight);
+  }
+
+  int m_fd {-1};
+  void* m_sq {};
+  void* m_cq {};
+  io_uring_sqe* m_sqEntries {};
+  std::size_t m_sqSize {};
+  std::size_t m_cqSize {};
+  std::size_t m_sqEntriesSize {};
+  unsigned* m_sqHead {};
+  unsigned* m_sqTail {};
+  unsigned m_sqMask {};
+  unsigned m_sqCapacity {};
+  // Tail of the submission queue including entries not yet published
+  unsigned m_tail {};
+  unsigned* m_cqHead {};
+  unsigned* m_cqTail {};
+  unsigned m_cqMask {};
+  io_uring_cqe* m_cqEntries {};
+  // Submitted operations that haven't completed yet
+  std::size_t m_inFlight {};
+};
+
+// Number of files each worker has in flight at once
+std::size_t constexpr ringSlots = 32;
+// Every slot has at most three operations in flight, and each completion
+// queues at most two more, so the queue never fills up between waits
+unsigned constexpr ringEntries = 8 * ringSlots;
+
+enum class Operation : std::uint64_t {
+  openInput,
+  statInput,
+  read,
+  closeInput,
+  openOutput,
+  write,
+  closeOutput,
+};
+
+// A file being converted by convert_with_io_uring
+struct FileSlot {
+  std::size_t file {};
+  int fd {-1};
+  // Operations that must complete before the file moves on
+  unsigned pending {};
+  bool failed {};
+  struct statx status {};
+  // Bytes read or written so far
+  std::size_t done {};
+  string text;
+  string out;
+  string outputPath;
+};
+
+auto user_data(std::size_t const slot, Operation const operation)
+    -> std::uint64_t {
+  return slot << 3U | static_cast<std::uint64_t>(operation);
+}
+
+// Converts the files with up to ringSlots of them in flight, so that opening,
+// reading, writing and closing them costs a fraction of a system call each.
+// returns false if io_uring failed, leaving the file it was converting
+// unconverted
+auto convert_with_io_uring(Batch& batch, IoUring& ring) -> bool {
+  auto slots = std::vector<FileSlot>(ringSlots);
+  auto values = std::vector<double> {};
+  auto active = std::size_t {};
+  auto ok = true;
+
+  auto const queue = [&ring, &ok](std::size_t const slot,
+                                  Operation const operation, auto&& prepare) {
+    auto entry = io_uring_sqe {};
+    entry.user_data = user_data(slot, operation);
+    prepare(entry);
+    ok = ok && ring.push(entry);
+  };
+  auto const queueClose = [&queue](std::size_t const slot,
+                                   Operation const operation, int const fd) {
+    queue(slot, operation, [fd](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_CLOSE;
+      entry.fd = fd;
+    });
+  };
+  auto const queueRead = [&slots, &queue](std::size_t const i) {
+    auto& slot = slots[i];
+    queue(i, Operation::read, [&slot](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_READ;
+      entry.fd = slot.fd;
+      entry.addr =
+          reinterpret_cast<std::uint64_t>(slot.text.data() + slot.done);
+      entry.len = static_cast<std::uint32_t>(
+          std::min<std::size_t>(slot.text.size() - slot.done, INT32_MAX));
+      entry.off = slot.done;
+    });
+  };
+  auto const queueWrite = [&slots, &queue](std::size_t const i) {
+    auto& slot = slots[i];
+    queue(i, Operation::write, [&slot](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_WRITE;
+      entry.fd = slot.fd;
+      entry.addr =
+          reinterpret_cast<std::uint64_t>(slot.out.data() + slot.done);
+      entry.len = static_cast<std::uint32_t>(
+          std::min<std::size_t>(slot.out.size() - slot.done, INT32_MAX));
+      entry.off = slot.done;
+    });
+  };
+
+  // Starts converting the next file in slot i, if there is one
+  auto const start = [&](std::size_t const i) {
+    auto const file = batch.take();
+    if (!file) {
+      return;
+    }
+    ++active;
+    auto& slot = slots[i];
+    slot.file = *file;
+    slot.fd = -1;
+    slot.pending = 2;
+    slot.failed = false;
+    slot.done = 0;
+    auto const* const path = batch.files[*file].c_str();
+    queue(i, Operation::openInput, [path](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_OPENAT;
+      entry.fd = AT_FDCWD;
+      entry.addr = reinterpret_cast<std::uint64_t>(path);
+      entry.open_flags = O_RDONLY | O_CLOEXEC;
+    });
+    queue(i, Operation::statInput, [path, &slot](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_STATX;
+      entry.fd = AT_FDCWD;
+      entry.addr = reinterpret_cast<std::uint64_t>(path);
+      entry.len = STATX_SIZE;
+      entry.off = reinterpret_cast<std::uint64_t>(&slot.status);
+    });
+  };
+  auto const finish = [&](std::size_t const i, string_view const error) {
+    if (!error.empty()) {
+      batch.reportError(slots[i].file, error);
+    }
+    --active;
+    start(i);
+  };
+
+  auto const convert = [&](std::size_t const i) {
+    auto& slot = slots[i];
+    queueClose(i, Operation::closeInput, slot.fd);
+    slot.fd = -1;
+    if (auto const invalid = convert_text(slot.text, batch.conversions,
+                                          batch.format, values, slot.out)) {
+      finish(i, "Invalid value (" + string {*invalid} + ").");
+      return;
+    }
+    slot.outputPath = batch.outputPath(slot.file).string();
+    auto const* const path = slot.outputPath.c_str();
+    queue(i, Operation::openOutput, [path](io_uring_sqe& entry) {
+      entry.opcode = IORING_OP_OPENAT;
+      entry.fd = AT_FDCWD;
+      entry.addr = reinterpret_cast<std::uint64_t>(path);
+      entry.open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      entry.len = 0666;
+    });
+  };
+
+  auto const handle = [&](std::uint64_t const userData, int const result) {
+    auto const i = static_cast<std::size_t>(userData >> 3U);
+    auto& slot = slots[i];
+    switch (static_cast<Operation>(userData & 7U)) {
+    case Operation::openInput:
+    case Operation::statInput:
+      if (result < 0) {
+        slot.failed = true;
+      } else if (static_cast<Operation>(userData & 7U) ==
+                 Operation::openInput) {
+        slot.fd = result;
+      }
+      if (--slot.pending > 0) {
+        return;
+      }
+      if (slot.failed) {
+        if (slot.fd >= 0) {
+          queueClose(i, Operation::closeInput, slot.fd);
+        }
+        finish(i, "Could not read file.");
+        return;
+      }
+      slot.text.resize(slot.status.stx_size);
+      if (slot.text.empty()) {
+        convert(i);
+      } else {
+        queueRead(i);
+      }
+      return;
+    case Operation::read:
+      if (result < 0) {
+        queueClose(i, Operation::closeInput, slot.fd);
+        finish(i, "Could not read file.");
+        return;
+      }
+      slot.done += static_cast<std::size_t>(result);
+      if (result == 0) {
+        // The file was truncated after its size was read
+        slot.text.resize(slot.done);
+      }
+      if (slot.done < slot.text.size()) {
+        queueRead(i);
+      } else {
+        convert(i);
+      }
+      return;
+    case Operation::closeInput:
+      // Nothing was written, so failing to close the file doesn't matter
+      return;
+    case Operation::openOutput:
+      if (result < 0) {
+        finish(i, "Could not write converted file.");
+        return;
+      }
+      slot.fd = result;
+      slot.done = 0;
+      if (slot.out.empty()) {
+        queueClose(i, Operation::closeOutput, slot.fd);
+      } else {
+        queueWrite(i);
+      }
+      return;
+    case Operation::write:
+      if (result <= 0) {
+        slot.failed = true;
+      } else {
+        slot.done += static_cast<std::size_t>(result);
+      }
+      if (!slot.failed && slot.done < slot.out.size()) {
+        queueWrite(i);
+      } else {
+        queueClose(i, Operation::closeOutput, slot.fd);
+      }
+      return;
+    case Operation::closeOutput:
+      slot.fd = -1;
+      finish(i, slot.failed || result < 0 ? "Could not write converted file."
+                                          : "");
+      return;
+    }
+  };
+
+  for (auto i = std::size_t {}; i < slots.size(); ++i) {
+    start(i);
+  }
+  while (ok && active > 0) {
+    ok = ring.wait(handle);
+  }
+  if (!ok) {
+    // The operations in flight point into the slots, so they have to complete
+    // before the slots are freed. Files they open are closed unconverted.
+    ring.drain([](std::uint64_t const userData, int const result) {
+      auto const operation = static_cast<Operation>(userData & 7U);
+      if ((operation == Operation::openInput ||
+           operation == Operation::openOutput) &&
+          result >= 0) {
+        close(result);
+      }
+    });
+  }
+  return ok;
+}
+
+#endif
+
+} // namespace
+
+auto convertFiles(std::vector<fs::path> const& inputs,
+                  fs::path const& outputDirectory,
+                  std::vector<Conversion> const& conversions,
+                  NumberFormat const& format) -> bool {
+  auto const files = expand_inputs(inputs);
+  if (!files) {
+    return false;
+  }
+  if (files->empty()) {
+    return true;
+  }
+
+  auto error = std::error_code {};
+  fs::create_directories(outputDirectory, error);
+  if (error) {
+    cerr << "[Output] Could not create directory " << outputDirectory.string()
+         << ".\n";
+    return false;
+  }
+
+  if (!check_outputs(*files, outputDirectory)) {
+    return false;
+  }
+
+  auto batch = Batch {*files, outputDirectory, conversions, format};
+  auto const worker = [&batch] {
+#ifdef JCONVERTER_HAS_IO_URING
+    // Each worker has its own ring, and uses the thread pool fallback if
+    // io_uring isn't available
+    if (auto ring = IoUring::create(ringEntries)) {
+      if (!convert_with_io_uring(batch, *ring)) {
+        auto const lock = std::lock_guard {batch.errorMutex};
+        cerr << "[Output] io_uring failed, some files were not converted.\n";
+        batch.succeeded = false;
+      }
+      return;
+    }
+#endif
+    convert_synchronously(batch);
+  };
+
+  auto const threadCount = std::clamp<std::size_t>(
+      std::thread::hardware_concurrency(), 1, files->size());
+  auto threads = std::vector<std::thread> {};
+  for (auto i = std::size_t {1}; i < threadCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return batch.succeeded;
+}
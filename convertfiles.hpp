@@ -0,0 +1,25 @@
+#pragma once
+
+#include "logic.hpp"
+#include "parsenumbers.hpp"
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Appends value converted with every conversion to out as a tab separated row
+auto appendRow(std::string& out, std::vector<Conversion> const& conversions,
+               double value) -> void;
+
+// Converts every file in inputs (or every regular file in it if it's a
+// directory) to a file with the same name in outputDirectory, with one row per
+// value. Files are converted concurrently by a pool of threads, each reading
+// and writing a whole file at a time. On Linux each thread keeps many files in
+// flight through io_uring instead, so that the system calls are batched.
+// returns false and reports the errors if any file couldn't be converted or
+// two inputs have the same name
+auto convertFiles(std::vector<std::filesystem::path> const& inputs,
+                  std::filesystem::path const& outputDirectory,
+                  std::vector<Conversion> const& conversions,
+                  NumberFormat const& format) -> bool;
@@ -1,61 +1,122 @@
 #include "convertfromstrings.hpp"
 
+#include "customunits.hpp"
+#include "kernels.hpp"
 #include "logic.hpp"
+#include "parsenumbers.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <iostream>
 #include <optional>
-#include <stdexcept>
-#include <string>
 #include <string_view>
+#include <system_error>
+#include <utility>
 
 using std::cerr;
-using std::string;
 using std::string_view;
 
-auto convert(string_view const fromString, string_view const toString,
-             double const value) -> std::optional<double> {
-  VariantMap const vmap;
-
-  auto const stringToUnit = [&vmap](string unitString) -> std::optional<Unit> {
-    try {
-      std::transform(unitString.begin(), unitString.end(), unitString.begin(),
-                     [](char unsigned c) { return std::tolower(c); });
-      return Unit {vmap.at(unitString)};
-    } catch (const std::out_of_range&) {
-      return std::nullopt;
-    }
-  };
-
-  auto const fromUnit = stringToUnit(string {fromString});
+static std::optional<CustomUnits> customUnits;
+
+auto loadCustomUnits(std::filesystem::path const& definitionPath) -> bool {
+  customUnits = CustomUnits::load(definitionPath);
+  return customUnits.has_value();
+}
+
+auto stringToUnit(string_view const unitString) -> std::optional<ScaledUnit> {
+  static VariantMap const vmap;
+
+  // Longer than any unit's name, so the string is lowercased on the stack
+  auto buffer = std::array<char, CustomUnits::maxNameSize + 1> {};
+  if (unitString.size() > buffer.size()) {
+    return std::nullopt;
+  }
+  std::transform(unitString.cbegin(), unitString.cend(), buffer.begin(),
+                 [](char unsigned c) { return std::tolower(c); });
+  auto const lowerString = string_view {buffer.data(), unitString.size()};
+
+  if (auto const unit = vmap.find(lowerString)) {
+    return ScaledUnit {Unit {*unit}};
+  }
+  if (customUnits) {
+    return customUnits->find(lowerString);
+  }
+  return std::nullopt;
+}
+
+auto static stringsToUnits(string_view const fromString,
+                           string_view const toString)
+    -> std::optional<std::pair<ScaledUnit, ScaledUnit>> {
+  auto const fromUnit = stringToUnit(fromString);
   if (!fromUnit) {
     cerr << "[From] is not a valid unit (" << fromString << ").\n";
     return std::nullopt;
   }
 
-  auto const toUnit = stringToUnit(string {toString});
+  auto const toUnit = stringToUnit(toString);
   if (!toUnit) {
     cerr << "[To] is not a valid unit (" << toString << ").\n";
     return std::nullopt;
   }
 
-  auto const result = convert(*fromUnit, *toUnit, value);
+  return std::pair {*fromUnit, *toUnit};
+}
+
+auto parseValue(string_view const valueString, NumberFormat const& format)
+    -> std::optional<double> {
+  auto const [value, error] = parseNumber(valueString, format);
+  if (error == std::errc::result_out_of_range) {
+    cerr << "[Value] is out of range for a double (" << valueString << ").\n";
+    return std::nullopt;
+  }
+  if (error != std::errc {}) {
+    cerr << "[Value] is not a valid number (" << valueString << ").\n";
+    return std::nullopt;
+  }
+  return value;
+}
+
+auto conversion(string_view const fromString, string_view const toString)
+    -> std::optional<Conversion> {
+  auto const units = stringsToUnits(fromString, toString);
+  if (!units) {
+    return std::nullopt;
+  }
+
+  auto const& [fromUnit, toUnit] = *units;
+  auto const result = conversion(fromUnit.unit, toUnit.unit);
   if (!result) {
-    cerr << "ERR: Units are of different types.";
+    cerr << "ERR: Units are of different types.\n";
+    return std::nullopt;
   }
-  return result;
+  // Scale the value into fromUnit's built-in unit before converting, and out
+  // of toUnit's built-in unit after.
+  return Conversion {result->scale * fromUnit.scale / toUnit.scale,
+                     result->offset / toUnit.scale};
 }
 
 auto convert(string_view const fromString, string_view const toString,
-             string const& valueString) -> std::optional<double> {
-  try {
-    return convert(fromString, toString, stod(valueString));
-  } catch (const std::invalid_argument&) {
-    cerr << "[Value] is not a valid number (" << valueString << ").\n";
+             double const value) -> std::optional<double> {
+  auto const units = stringsToUnits(fromString, toString);
+  if (!units) {
     return std::nullopt;
-  } catch (const std::out_of_range&) {
-    cerr << "[Value] is out of range for a double (" << valueString << ").\n";
+  }
+
+  auto const& [fromUnit, toUnit] = *units;
+  auto const maybeKernel = kernel(fromUnit.unit, toUnit.unit);
+  if (!maybeKernel) {
+    cerr << "ERR: Units are of different types.\n";
+    return std::nullopt;
+  }
+  return maybeKernel->scalar(value * fromUnit.scale) / toUnit.scale;
+}
+
+auto convert(string_view const fromString, string_view const toString,
+             string_view const valueString) -> std::optional<double> {
+  auto const value = parseValue(valueString);
+  if (!value) {
     return std::nullopt;
   }
+  return convert(fromString, toString, *value);
 }
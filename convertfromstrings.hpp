@@ -1,9 +1,11 @@
 #pragma once
 
+#include "customunits.hpp"
 #include "logic.hpp"
+#include "parsenumbers.hpp"
 
+#include <filesystem>
 #include <optional>
-#include <string>
 #include <string_view>
 #include <unordered_map>
 
@@ -13,6 +15,17 @@ public:
     return m_map.at(str);
   }
 
+  // Unlike at this doesn't throw, so a failed lookup doesn't allocate an
+  // exception
+  [[nodiscard]] auto find(std::string_view const str) const
+      -> std::optional<Unit::Variant> {
+    auto const it = m_map.find(str);
+    if (it == m_map.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
 private:
   std::unordered_map<std::string_view, Unit::Variant> const m_map {
       {"celsius", Unit::Temperature::celsius},
@@ -133,7 +146,28 @@ private:
   };
 };
 
+// Makes the units defined in the given file available to the functions below
+// in addition to the built-in units. Must not be called concurrently with
+// them.
+// returns false and reports the error if the definitions can't be loaded
+auto loadCustomUnits(std::filesystem::path const& definitionPath) -> bool;
+
+// The functions below don't allocate unless they report an error, apart from
+// the built-in unit table which is created by the first call.
+
+// returns empty optional if the string doesn't name a unit
+auto stringToUnit(std::string_view unitString) -> std::optional<ScaledUnit>;
+
+// returns empty optional and reports the error if the string isn't a number
+auto parseValue(std::string_view valueString, NumberFormat const& format = {})
+    -> std::optional<double>;
+
+// returns empty optional and reports the error if either string doesn't name a
+// unit or if the units are of different types
+auto conversion(std::string_view fromString, std::string_view toString)
+    -> std::optional<Conversion>;
+
 auto convert(std::string_view fromString, std::string_view toString,
              double valueString) -> std::optional<double>;
 auto convert(std::string_view fromString, std::string_view toString,
-             std::string const& valueString) -> std::optional<double>;
+             std::string_view valueString) -> std::optional<double>;
@@ -0,0 +1,326 @@
+#include "convertjson.hpp"
+
+#include "convertfromstrings.hpp"
+#include "logic.hpp"
+#include "parsenumbers.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using std::cerr;
+using std::string;
+using std::string_view;
+
+namespace {
+
+auto is_space(char const c) -> bool {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// A minimal non-allocating scanner for the members of a single JSON object.
+// It only finds where members start and end and doesn't validate more than
+// needed for that.
+class ObjectScanner {
+public:
+  explicit ObjectScanner(string_view const text) : m_text {text} {}
+
+  // Calls onMember(key, value) for every member of the object, where key is
+  // the raw string between the key's quotes and value the member's value as
+  // written.
+  // returns false if the text isn't an object
+  template <typename OnMember>
+  auto scan(OnMember&& onMember) -> bool {
+    skip_space();
+    if (!consume('{')) {
+      return false;
+    }
+    skip_space();
+    if (consume('}')) {
+      return true;
+    }
+    for (;;) {
+      skip_space();
+      auto const keyBegin = m_pos;
+      if (!skip_string()) {
+        return false;
+      }
+      auto const key = m_text.substr(keyBegin + 1, m_pos - keyBegin - 2);
+      skip_space();
+      if (!consume(':')) {
+        return false;
+      }
+      skip_space();
+      auto const valueBegin = m_pos;
+      if (!skip_value()) {
+        return false;
+      }
+      onMember(key, m_text.substr(valueBegin, m_pos - valueBegin));
+      skip_space();
+      if (consume('}')) {
+        return true;
+      }
+      if (!consume(',')) {
+        return false;
+      }
+    }
+  }
+
+private:
+  auto skip_space() -> void {
+    while (m_pos < m_text.size() && is_space(m_text[m_pos])) {
+      ++m_pos;
+    }
+  }
+
+  auto consume(char const c) -> bool {
+    if (m_pos < m_text.size() && m_text[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  auto skip_string() -> bool {
+    if (!consume('"')) {
+      return false;
+    }
+    while (m_pos < m_text.size()) {
+      auto const c = m_text[m_pos++];
+      if (c == '\\') {
+        ++m_pos;
+      } else if (c == '"') {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto skip_value() -> bool {
+    if (m_pos >= m_text.size()) {
+      return false;
+    }
+    auto const c = m_text[m_pos];
+    if (c == '"') {
+      return skip_string();
+    }
+    if (c == '{' || c == '[') {
+      // Nested values are skipped by counting brackets outside of strings
+      auto depth = 0;
+      while (m_pos < m_text.size()) {
+        auto const current = m_text[m_pos];
+        if (current == '"') {
+          if (!skip_string()) {
+            return false;
+          }
+          continue;
+        }
+        ++m_pos;
+        if (current == '{' || current == '[') {
+          ++depth;
+        } else if ((current == '}' || current == ']') && --depth == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+    // Numbers, true, false and null
+    auto const begin = m_pos;
+    while (m_pos < m_text.size() && !is_space(m_text[m_pos]) &&
+           m_text[m_pos] != ',' && m_text[m_pos] != '}' &&
+           m_text[m_pos] != ']') {
+      ++m_pos;
+    }
+    return m_pos != begin;
+  }
+
+  string_view m_text;
+  std::size_t m_pos {};
+};
+
+// Caches the conversions from recently seen units to a field's target. Most
+// streams only use a few units per field, so after the first few records
+// resolving a unit is a hash and a string comparison.
+class ConversionCache {
+public:
+  explicit ConversionCache(string_view const target) : m_target {target} {}
+
+  // Sets resolved to whether the unit wasn't cached and had to be looked up.
+  // returns empty optional if the unit can't be converted to the target
+  auto find(string_view const unit, bool& resolved)
+      -> std::optional<Conversion> {
+    auto& entry = m_entries[std::hash<string_view> {}(unit) % m_entries.size()];
+    resolved = !entry.valid || entry.unit != unit;
+    if (resolved) {
+      // Invalid units are cached too so that they're only reported once
+      entry.unit.assign(unit.data(), unit.size());
+      entry.conversion = conversion(unit, m_target);
+      entry.valid = true;
+    }
+    return entry.conversion;
+  }
+
+private:
+  struct Entry {
+    string unit;
+    std::optional<Conversion> conversion;
+    bool valid {};
+  };
+
+  string_view m_target;
+  std::array<Entry, 16> m_entries {};
+};
+
+struct Replacement {
+  string_view original;
+  string_view text;
+};
+
+} // namespace
+
+auto convertJsonLines(std::istream& input, std::ostream& output,
+                      std::vector<JsonField> const& fields) -> bool {
+  // Two fields sharing a member would replace it twice
+  auto keys = std::vector<string_view> {};
+  for (auto const& field : fields) {
+    keys.push_back(field.valueKey);
+    keys.push_back(field.unitKey);
+  }
+  std::sort(keys.begin(), keys.end());
+  if (auto const duplicate = std::adjacent_find(keys.cbegin(), keys.cend());
+      duplicate != keys.cend()) {
+    cerr << "[JSON] Key " << *duplicate
+         << " is used more than once by the fields.\n";
+    return false;
+  }
+
+  auto caches = std::vector<ConversionCache> {};
+  for (auto const& field : fields) {
+    caches.emplace_back(field.target);
+  }
+
+  // Reused between records so that converting a record doesn't allocate
+  auto succeeded = true;
+  auto line = string {};
+  auto out = string {};
+  auto values = std::vector<std::optional<string_view>>(fields.size());
+  auto units = std::vector<std::optional<string_view>>(fields.size());
+  auto numbers = std::vector<std::array<char, 32>>(fields.size());
+  auto replacements = std::vector<Replacement> {};
+  auto lineNumber = std::size_t {};
+
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    std::fill(values.begin(), values.end(), std::nullopt);
+    std::fill(units.begin(), units.end(), std::nullopt);
+    replacements.clear();
+
+    auto scanner = ObjectScanner {line};
+    auto const isObject =
+        scanner.scan([&](string_view const key, string_view const value) {
+          for (auto i = std::size_t {}; i < fields.size(); ++i) {
+            if (key == fields[i].valueKey) {
+              values[i] = value;
+            } else if (key == fields[i].unitKey) {
+              units[i] = value;
+            }
+          }
+        });
+    auto const reportError = [&](string_view const msg) {
+      cerr << "[JSON] line " << lineNumber << ": " << msg << '\n';
+      succeeded = false;
+    };
+    if (!isObject && !line.empty()) {
+      reportError("Not a JSON object.");
+    }
+
+    // Records with a field that can't be converted are copied unchanged
+    auto recordConverted = true;
+    for (auto i = std::size_t {}; isObject && i < fields.size(); ++i) {
+      if (!values[i] || !units[i]) {
+        continue;
+      }
+      auto const fieldError = [&](string_view const msg) {
+        reportError(msg);
+        recordConverted = false;
+      };
+      auto const unit = *units[i];
+      if (unit.size() < 2 || unit.front() != '"') {
+        fieldError("Unit of " + fields[i].valueKey + " is not a string.");
+        continue;
+      }
+      auto const value = parseNumber(*values[i]);
+      if (value.error != std::errc {}) {
+        fieldError("Value of " + fields[i].valueKey + " is not a number.");
+        continue;
+      }
+      auto resolved = false;
+      auto const conversion =
+          caches[i].find(unit.substr(1, unit.size() - 2), resolved);
+      if (!conversion) {
+        if (resolved) {
+          fieldError("Could not convert " + fields[i].valueKey + '.');
+        } else {
+          // Already reported, the record is still copied unchanged
+          succeeded = false;
+          recordConverted = false;
+        }
+        continue;
+      }
+      auto const converted = (*conversion)(value.value);
+      if (!std::isfinite(converted)) {
+        // JSON has no representation of infinity or NaN
+        fieldError("Converted " + fields[i].valueKey + " is out of range.");
+        continue;
+      }
+
+      // The shortest representation that round-trips
+      auto& number = numbers[i];
+      auto const end =
+          std::to_chars(number.data(), number.data() + number.size(),
+                        converted)
+              .ptr;
+      replacements.push_back(
+          {*values[i],
+           {number.data(), static_cast<std::size_t>(end - number.data())}});
+      replacements.push_back(
+          {unit.substr(1, unit.size() - 2), fields[i].target});
+    }
+    if (!recordConverted) {
+      replacements.clear();
+    }
+
+    // Copy the record with the replacements in order of their position
+    std::sort(replacements.begin(), replacements.end(),
+              [](Replacement const& a, Replacement const& b) {
+                return a.original.data() < b.original.data();
+              });
+    auto const record = string_view {line};
+    auto copied = std::size_t {};
+    for (auto const& replacement : replacements) {
+      auto const begin =
+          static_cast<std::size_t>(replacement.original.data() - record.data());
+      out.append(record.substr(copied, begin - copied));
+      out.append(replacement.text);
+      copied = begin + replacement.original.size();
+    }
+    out.append(record.substr(copied));
+    out += '\n';
+
+    if (out.size() >= std::size_t {1} << 16) {
+      output << out;
+      out.clear();
+    }
+  }
+  output << out;
+  return succeeded;
+}
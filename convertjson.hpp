@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// A quantity in a JSON record, stored as a number member and the name of its
+// unit in a string member, e.g. {"v":12.3,"u":"lb"}.
+struct JsonField {
+  std::string valueKey;
+  std::string unitKey;
+  // The unit the field is converted to
+  std::string target;
+};
+
+// Converts the fields of every record in a stream of JSON Lines (one object
+// per line) to their target units, rewriting only the fields' members and
+// copying everything else unchanged. Records whose fields can't be converted
+// are reported and copied unchanged.
+// returns false if any record couldn't be converted, or without converting
+// anything if two fields use the same key
+auto convertJsonLines(std::istream& input, std::ostream& output,
+                      std::vector<JsonField> const& fields) -> bool;
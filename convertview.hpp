@@ -0,0 +1,255 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+#ifdef __cpp_lib_ranges
+#include <ranges>
+#endif
+
+// An iterator adaptor converting the values of the underlying iterator as
+// they're read. The conversion is looked up once when the iterator is
+// created, so reading a value costs the same as converting it in a
+// hand-written loop.
+template <typename Iterator>
+class ConvertIterator {
+  using Traits = std::iterator_traits<Iterator>;
+
+public:
+  // Converted values are computed when read, so they're returned by value.
+  // C++17 forward iterators must return references, so like
+  // std::ranges::transform_view's iterator this is only an input iterator to
+  // C++17 algorithms, and as strong as Iterator to C++20 ones.
+  using iterator_category = std::input_iterator_tag;
+#ifdef __cpp_lib_ranges
+  using iterator_concept = std::conditional_t<
+      std::random_access_iterator<Iterator>, std::random_access_iterator_tag,
+      std::conditional_t<
+          std::bidirectional_iterator<Iterator>,
+          std::bidirectional_iterator_tag,
+          std::conditional_t<std::forward_iterator<Iterator>,
+                             std::forward_iterator_tag,
+                             std::input_iterator_tag>>>;
+#endif
+  using value_type = double;
+  using difference_type = typename Traits::difference_type;
+  using pointer = void;
+  using reference = double;
+
+  ConvertIterator() = default;
+
+  constexpr ConvertIterator(Iterator iterator, Conversion const& conversion)
+      : m_iterator {std::move(iterator)}, m_conversion {conversion} {}
+
+  [[nodiscard]] constexpr auto base() const -> Iterator const& {
+    return m_iterator;
+  }
+
+  [[nodiscard]] constexpr auto operator*() const -> double {
+    return m_conversion(static_cast<double>(*m_iterator));
+  }
+
+  [[nodiscard]] constexpr auto operator[](difference_type const n) const
+      -> double {
+    return m_conversion(static_cast<double>(m_iterator[n]));
+  }
+
+  constexpr auto operator++() -> ConvertIterator& {
+    ++m_iterator;
+    return *this;
+  }
+
+  constexpr auto operator++(int) -> ConvertIterator {
+    auto copy = *this;
+    ++m_iterator;
+    return copy;
+  }
+
+  constexpr auto operator--() -> ConvertIterator& {
+    --m_iterator;
+    return *this;
+  }
+
+  constexpr auto operator--(int) -> ConvertIterator {
+    auto copy = *this;
+    --m_iterator;
+    return copy;
+  }
+
+  constexpr auto operator+=(difference_type const n) -> ConvertIterator& {
+    m_iterator += n;
+    return *this;
+  }
+
+  constexpr auto operator-=(difference_type const n) -> ConvertIterator& {
+    m_iterator -= n;
+    return *this;
+  }
+
+  [[nodiscard]] friend constexpr auto operator+(ConvertIterator iterator,
+                                                difference_type const n)
+      -> ConvertIterator {
+    return iterator += n;
+  }
+
+  [[nodiscard]] friend constexpr auto operator+(difference_type const n,
+                                                ConvertIterator iterator)
+      -> ConvertIterator {
+    return iterator += n;
+  }
+
+  [[nodiscard]] friend constexpr auto operator-(ConvertIterator iterator,
+                                                difference_type const n)
+      -> ConvertIterator {
+    return iterator -= n;
+  }
+
+  [[nodiscard]] friend constexpr auto operator-(ConvertIterator const& a,
+                                                ConvertIterator const& b)
+      -> difference_type {
+    return a.m_iterator - b.m_iterator;
+  }
+
+  [[nodiscard]] friend constexpr auto operator==(ConvertIterator const& a,
+                                                 ConvertIterator const& b)
+      -> bool {
+    return a.m_iterator == b.m_iterator;
+  }
+
+  [[nodiscard]] friend constexpr auto operator!=(ConvertIterator const& a,
+                                                 ConvertIterator const& b)
+      -> bool {
+    return a.m_iterator != b.m_iterator;
+  }
+
+  [[nodiscard]] friend constexpr auto operator<(ConvertIterator const& a,
+                                                ConvertIterator const& b)
+      -> bool {
+    return a.m_iterator < b.m_iterator;
+  }
+
+  [[nodiscard]] friend constexpr auto operator>(ConvertIterator const& a,
+                                                ConvertIterator const& b)
+      -> bool {
+    return b < a;
+  }
+
+  [[nodiscard]] friend constexpr auto operator<=(ConvertIterator const& a,
+                                                 ConvertIterator const& b)
+      -> bool {
+    return !(b < a);
+  }
+
+  [[nodiscard]] friend constexpr auto operator>=(ConvertIterator const& a,
+                                                 ConvertIterator const& b)
+      -> bool {
+    return !(a < b);
+  }
+
+private:
+  Iterator m_iterator {};
+  Conversion m_conversion {};
+};
+
+// A lazily converted view of the values in [first, last). It doesn't own the
+// values, so they must outlive the view.
+template <typename Iterator>
+class ConvertView
+#ifdef __cpp_lib_ranges
+    : public std::ranges::view_base
+#endif
+{
+public:
+  ConvertView() = default;
+
+  constexpr ConvertView(Iterator first, Iterator last,
+                        Conversion const& conversion)
+      : m_first {std::move(first), conversion},
+        m_last {std::move(last), conversion} {}
+
+  [[nodiscard]] constexpr auto begin() const -> ConvertIterator<Iterator> {
+    return m_first;
+  }
+
+  [[nodiscard]] constexpr auto end() const -> ConvertIterator<Iterator> {
+    return m_last;
+  }
+
+  [[nodiscard]] constexpr auto size() const -> std::size_t {
+    return static_cast<std::size_t>(
+        std::distance(m_first.base(), m_last.base()));
+  }
+
+  [[nodiscard]] constexpr auto empty() const -> bool {
+    return m_first == m_last;
+  }
+
+private:
+  ConvertIterator<Iterator> m_first;
+  ConvertIterator<Iterator> m_last;
+};
+
+#ifdef __cpp_lib_ranges
+// The view's iterators don't refer to the view, so they may outlive it
+template <typename Iterator>
+inline constexpr bool
+    std::ranges::enable_borrowed_range<ConvertView<Iterator>> = true;
+#endif
+
+template <typename Iterator>
+[[nodiscard]] constexpr auto convertView(Iterator first, Iterator last,
+                                         Conversion const& conversion)
+    -> ConvertView<Iterator> {
+  return {std::move(first), std::move(last), conversion};
+}
+
+namespace views {
+
+struct ConvertAdaptor {
+  Conversion conversion;
+};
+
+// For use as values | views::convert(conversion), where conversion comes from
+// conversion(fromUnit, toUnit).
+[[nodiscard]] constexpr auto convert(Conversion const& conversion)
+    -> ConvertAdaptor {
+  return {conversion};
+}
+
+template <typename Range>
+[[nodiscard]] constexpr auto operator|(Range&& range,
+                                       ConvertAdaptor const& adaptor) {
+#ifdef __cpp_lib_ranges
+  if constexpr (!std::is_lvalue_reference_v<Range> &&
+                !std::ranges::borrowed_range<Range> &&
+                std::ranges::view<std::remove_cvref_t<Range>>) {
+    // The iterators of views like filter_view refer to the view, so the
+    // temporary view is moved into a transform_view that owns it
+    return std::forward<Range>(range) |
+           std::views::transform(adaptor.conversion);
+  } else {
+    static_assert(std::is_lvalue_reference_v<Range> ||
+                      std::ranges::borrowed_range<Range>,
+                  "The view doesn't own the values, so converting a "
+                  "temporary container would leave it dangling");
+    return convertView(std::ranges::begin(range), std::ranges::end(range),
+                       adaptor.conversion);
+  }
+#else
+  static_assert(std::is_lvalue_reference_v<Range>,
+                "The view doesn't own the values, so converting a temporary "
+                "range would leave it dangling");
+  using std::begin;
+  using std::end;
+  return convertView(begin(range), end(range), adaptor.conversion);
+#endif
+}
+
+} // namespace views
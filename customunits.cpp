@@ -0,0 +1,360 @@
+#include "customunits.hpp"
+
+#include "convertfromstrings.hpp"
+#include "logic.hpp"
+#include "parsenumbers.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JCONVERTER_HAS_MMAP 1
+#endif
+
+using std::cerr;
+using std::string;
+using std::string_view;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::array constexpr cacheMagic {'J', 'C', 'U', 'N', 'I', 'T', 'S', '2'};
+
+// The cache is only ever read on the machine that wrote it, so the records are
+// stored in native byte order and layout.
+struct CacheHeader {
+  std::array<char, 8> magic;
+  std::uint64_t sourceSize;
+  std::int64_t sourceTime;
+  std::uint64_t count;
+};
+
+struct CacheRecord {
+  // Lowercase and NUL padded. Records are sorted by name.
+  std::array<char, CustomUnits::maxNameSize + 1> name;
+  double scale;
+  // The unit's UnitId bits
+  std::uint16_t unit;
+  std::array<std::uint8_t, 6> padding;
+};
+
+static_assert(sizeof(CacheHeader) == 32 && sizeof(CacheRecord) == 64,
+              "The cache layout must not contain implicit padding");
+static_assert(alignof(CacheRecord) <= sizeof(CacheHeader),
+              "Records directly following the header must be aligned");
+
+struct SourceStamp {
+  std::uint64_t size;
+  std::int64_t time;
+};
+
+auto source_stamp(fs::path const& path) -> std::optional<SourceStamp> {
+  auto error = std::error_code {};
+  auto const size = fs::file_size(path, error);
+  if (error) {
+    return std::nullopt;
+  }
+  auto const time = fs::last_write_time(path, error);
+  if (error) {
+    return std::nullopt;
+  }
+  return SourceStamp {size, static_cast<std::int64_t>(
+                                time.time_since_epoch().count())};
+}
+
+auto record_name(CacheRecord const& record) -> string_view {
+  auto const end = std::find(record.name.cbegin(), record.name.cend(), '\0');
+  return {record.name.data(),
+          static_cast<std::size_t>(end - record.name.cbegin())};
+}
+
+auto to_lower(string str) -> string {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](char unsigned c) { return std::tolower(c); });
+  return str;
+}
+
+auto encode(string_view const name, UnitId const unit, double const scale)
+    -> CacheRecord {
+  auto record = CacheRecord {};
+  std::copy(name.cbegin(), name.cend(), record.name.begin());
+  record.scale = scale;
+  record.unit = unit.bits();
+  return record;
+}
+
+// returns empty optional if the record doesn't hold a valid unit (e.g. if the
+// cache is corrupt)
+auto decode(CacheRecord const& record) -> std::optional<ScaledUnit> {
+  auto const unit = UnitId::fromBits(record.unit);
+  if (!unit) {
+    return std::nullopt;
+  }
+  return ScaledUnit {unit->unit(), record.scale};
+}
+
+// Parses the definition file into records sorted by name.
+auto compile(fs::path const& definitionPath)
+    -> std::optional<std::vector<CacheRecord>> {
+  auto file = std::ifstream {definitionPath};
+  if (!file) {
+    cerr << "[Units] Could not open " << definitionPath.string() << ".\n";
+    return std::nullopt;
+  }
+
+  VariantMap const builtins;
+  auto const findBuiltin = [&builtins](string const& name) {
+    return builtins.find(name);
+  };
+
+  auto units = std::map<string, std::pair<UnitId, double>> {};
+  auto lineNumber = 0;
+  auto const reportError = [&definitionPath, &lineNumber](string_view msg) {
+    cerr << "[Units] " << definitionPath.string() << ':' << lineNumber << ": "
+         << msg << '\n';
+  };
+
+  for (string line; std::getline(file, line);) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    auto stream = std::istringstream {line};
+    auto const words =
+        std::vector<string> {std::istream_iterator<string> {stream},
+                             std::istream_iterator<string> {}};
+
+    if (words.empty()) {
+      continue;
+    }
+    if (words.size() != 2 && words.size() != 3) {
+      reportError("Expected [Name] [Unit] or [Name] [Factor] [Unit].");
+      return std::nullopt;
+    }
+
+    auto const name = to_lower(words.front());
+    auto const baseName = to_lower(words.back());
+    if (name.size() > CustomUnits::maxNameSize) {
+      reportError("Unit name is too long (" + name + ").");
+      return std::nullopt;
+    }
+    if (findBuiltin(name) || units.count(name) != 0) {
+      reportError("Unit is already defined (" + name + ").");
+      return std::nullopt;
+    }
+
+    auto factor = 1.;
+    if (words.size() == 3) {
+      auto const parsed = parseNumber(words[1]);
+      factor = parsed.error == std::errc {} ? parsed.value : 0.;
+      if (!std::isfinite(factor) || factor <= 0.) {
+        reportError("Factor is not a valid positive number (" + words[1] +
+                    ").");
+        return std::nullopt;
+      }
+    }
+
+    if (auto const builtin = findBuiltin(baseName)) {
+      units.emplace(name, std::pair {UnitId {Unit {*builtin}}, factor});
+    } else if (auto const custom = units.find(baseName);
+               custom != units.end()) {
+      units.emplace(name, std::pair {custom->second.first,
+                                     custom->second.second * factor});
+    } else {
+      reportError("Unknown unit (" + baseName + ").");
+      return std::nullopt;
+    }
+  }
+
+  auto records = std::vector<CacheRecord> {};
+  records.reserve(units.size());
+  for (auto const& [name, unit] : units) {
+    records.push_back(encode(name, unit.first, unit.second));
+  }
+  return records;
+}
+
+// Failing to write the cache isn't an error since the definitions can still be
+// used. The cache is written to a temporary file first so that a concurrent
+// load never sees a partially written cache.
+auto write_cache(fs::path const& cachePath, SourceStamp const stamp,
+                 std::vector<CacheRecord> const& records) -> void {
+  auto header = CacheHeader {};
+  header.magic = cacheMagic;
+  header.sourceSize = stamp.size;
+  header.sourceTime = stamp.time;
+  header.count = records.size();
+
+  auto tmpPath = cachePath;
+  tmpPath += ".tmp";
+  {
+    auto file = std::ofstream {tmpPath, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(
+        reinterpret_cast<char const*>(records.data()),
+        static_cast<std::streamsize>(records.size() * sizeof(CacheRecord)));
+    if (!file) {
+      return;
+    }
+  }
+  auto error = std::error_code {};
+  fs::rename(tmpPath, cachePath, error);
+  if (error) {
+    fs::remove(tmpPath, error);
+  }
+}
+
+} // namespace
+
+class CustomUnits::Storage {
+public:
+  explicit Storage(std::vector<CacheRecord> records)
+      : m_owned {std::move(records)}, m_records {m_owned.data()},
+        m_count {m_owned.size()} {}
+
+  Storage(Storage const&) = delete;
+  auto operator=(Storage const&) -> Storage& = delete;
+
+  ~Storage() {
+#ifdef JCONVERTER_HAS_MMAP
+    if (m_mapping) {
+      munmap(m_mapping, m_mappingSize);
+    }
+#endif
+  }
+
+  // returns nullptr if the cache is missing, invalid or doesn't match stamp
+  [[nodiscard]] static auto map(fs::path const& cachePath,
+                                SourceStamp const stamp)
+      -> std::shared_ptr<Storage const> {
+#ifdef JCONVERTER_HAS_MMAP
+    auto const fd = ::open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat status {};
+    auto const size = fstat(fd, &status) == 0
+                          ? static_cast<std::size_t>(status.st_size)
+                          : std::size_t {};
+    auto* const mapping =
+        size < sizeof(CacheHeader)
+            ? MAP_FAILED
+            : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      return nullptr;
+    }
+    auto storage = std::make_shared<Storage>(std::vector<CacheRecord> {});
+    storage->m_mapping = mapping;
+    storage->m_mappingSize = size;
+    auto const* const bytes = static_cast<char const*>(mapping);
+#else
+    auto file = std::ifstream {cachePath, std::ios::binary};
+    auto const buffer =
+        std::vector<char> {std::istreambuf_iterator<char> {file},
+                           std::istreambuf_iterator<char> {}};
+    auto const size = buffer.size();
+    if (size < sizeof(CacheHeader)) {
+      return nullptr;
+    }
+    auto const* const bytes = buffer.data();
+#endif
+
+    auto header = CacheHeader {};
+    std::memcpy(&header, bytes, sizeof(header));
+    if (header.magic != cacheMagic || header.sourceSize != stamp.size ||
+        header.sourceTime != stamp.time ||
+        header.count != (size - sizeof(header)) / sizeof(CacheRecord) ||
+        (size - sizeof(header)) % sizeof(CacheRecord) != 0) {
+      return nullptr;
+    }
+
+#ifdef JCONVERTER_HAS_MMAP
+    storage->m_records =
+        reinterpret_cast<CacheRecord const*>(bytes + sizeof(header));
+    storage->m_count = header.count;
+    return storage;
+#else
+    auto records = std::vector<CacheRecord>(header.count);
+    std::memcpy(records.data(), bytes + sizeof(header),
+                records.size() * sizeof(CacheRecord));
+    return std::make_shared<Storage const>(std::move(records));
+#endif
+  }
+
+  [[nodiscard]] auto begin() const noexcept -> CacheRecord const* {
+    return m_records;
+  }
+
+  [[nodiscard]] auto end() const noexcept -> CacheRecord const* {
+    return m_records + m_count;
+  }
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t { return m_count; }
+
+private:
+  std::vector<CacheRecord> m_owned;
+  void* m_mapping {};
+  std::size_t m_mappingSize {};
+  CacheRecord const* m_records {};
+  std::size_t m_count {};
+};
+
+CustomUnits::CustomUnits(std::shared_ptr<Storage const> storage)
+    : m_storage {std::move(storage)} {}
+
+auto CustomUnits::load(fs::path const& definitionPath)
+    -> std::optional<CustomUnits> {
+  auto const stamp = source_stamp(definitionPath);
+  if (!stamp) {
+    cerr << "[Units] Could not open " << definitionPath.string() << ".\n";
+    return std::nullopt;
+  }
+
+  auto cachePath = definitionPath;
+  cachePath += ".cache";
+  if (auto storage = Storage::map(cachePath, *stamp)) {
+    return CustomUnits {std::move(storage)};
+  }
+
+  auto records = compile(definitionPath);
+  if (!records) {
+    return std::nullopt;
+  }
+  write_cache(cachePath, *stamp, *records);
+  return CustomUnits {std::make_shared<Storage const>(std::move(*records))};
+}
+
+auto CustomUnits::find(string_view const unitString) const
+    -> std::optional<ScaledUnit> {
+  auto const it = std::lower_bound(
+      m_storage->begin(), m_storage->end(), unitString,
+      [](CacheRecord const& record, string_view const name) {
+        return record_name(record) < name;
+      });
+  if (it == m_storage->end() || record_name(*it) != unitString) {
+    return std::nullopt;
+  }
+  return decode(*it);
+}
+
+auto CustomUnits::size() const noexcept -> std::size_t {
+  return m_storage->size();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+// A unit expressed as a multiple of a built-in unit. A value in the scaled
+// unit is converted to the built-in unit by multiplying it with scale.
+struct ScaledUnit {
+  Unit unit;
+  double scale {1.};
+};
+
+// Units and aliases loaded at runtime from a definition file. Each non-empty
+// line that isn't a comment (#) is either an alias of an existing unit or a
+// new unit defined as a multiple of an existing unit:
+//
+//   metre meter
+//   smoot 1.7018 meter
+//
+// The definitions are compiled to a binary cache next to the definition file
+// ("<file>.cache") which is memory mapped on later loads, so loading doesn't
+// have to parse the definitions again. The cache is recreated whenever the
+// definition file's size or modification time changes.
+class CustomUnits {
+public:
+  static std::size_t constexpr maxNameSize = 47;
+
+  // returns empty optional and reports the error if the definitions can't be
+  // read or are invalid
+  [[nodiscard]] static auto load(std::filesystem::path const& definitionPath)
+      -> std::optional<CustomUnits>;
+
+  // unitString must be lowercase
+  [[nodiscard]] auto find(std::string_view unitString) const
+      -> std::optional<ScaledUnit>;
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t;
+
+private:
+  class Storage;
+
+  explicit CustomUnits(std::shared_ptr<Storage const> storage);
+
+  std::shared_ptr<Storage const> m_storage;
+};
@@ -1,8 +1,21 @@
+#include "aggregate.hpp"
+#include "convertfiles.hpp"
 #include "convertfromstrings.hpp"
+#include "convertjson.hpp"
+#include "sharedmemory.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <istream>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
 
 using namespace std::string_view_literals;
 using std::cerr;
@@ -10,7 +23,31 @@ using std::string;
 using std::string_view;
 
 auto static print_usage(string_view const programName) -> void {
-  cerr << "Usage: " << programName << " [From] [To] [Value | -]\n\n";
+  cerr << "Usage: " << programName << " [From] [To] [Value | -]\n";
+  cerr << "       " << programName << " --to [To,...] [From] [Value | -]\n";
+  cerr << "       " << programName
+       << " --output [Dir] [From] [To] [File | Dir]...\n";
+  cerr << "       " << programName
+       << " --jsonl [ValueKey]:[UnitKey]:[To]...\n";
+  cerr << "       " << programName << " --shm [Name] [--workers [Count]]\n\n";
+  cerr << "Options:\n"
+          "\t--units [File]\tAlso use the units defined in [File]\n"
+          "\t--aggregate\tPrint statistics of the converted values instead of\n"
+          "\t\t\tthe values\n"
+          "\t--decimal [Char]\tDecimal separator of the values (default .)\n"
+          "\t--group [Char]\tSeparator between groups of digits in the "
+          "values\n"
+          "\t--output [Dir]\tConvert the values in every input file to a file\n"
+          "\t\t\twith the same name in [Dir]\n"
+          "\t--jsonl [ValueKey]:[UnitKey]:[To]\n"
+          "\t\t\tConvert the value and unit members of every JSON\n"
+          "\t\t\tobject on stdin to [To] (may be repeated)\n"
+          "\t--shm [Name]\tServe conversions to JConverter-shm-client through\n"
+          "\t\t\tshared memory until interrupted\n"
+          "\t--workers [Count]\tNumber of --shm worker threads (default 1)\n\n";
+  cerr << "[To] may be a comma separated list of units, in which case one\n"
+          "column is printed per unit. If [Value] is omitted or \"-\" every\n"
+          "value on stdin is converted.\n\n";
   cerr << "Available units:\n";
   cerr << "\t[Temperature]:\n";
   for (auto const unit : temperatureStrings) {
@@ -30,28 +67,234 @@ auto static print_usage(string_view const programName) -> void {
   }
 }
 
+auto static split(string_view str, char const delimiter)
+    -> std::vector<string_view> {
+  auto parts = std::vector<string_view> {};
+  for (auto pos = str.find(delimiter); pos != string_view::npos;
+       pos = str.find(delimiter)) {
+    parts.push_back(str.substr(0, pos));
+    str.remove_prefix(pos + 1);
+  }
+  parts.push_back(str);
+  return parts;
+}
+
+// Calls handleValue with every value in input. Values are parsed from large
+// chunks of input instead of one string per value.
+// returns false and reports the error if input contains an invalid value
+template <typename Handler>
+auto static read_values(std::istream& input, NumberFormat const& format,
+                        Handler&& handleValue) -> bool {
+  auto buffer = std::vector<char>(std::size_t {1} << 16);
+  auto filled = std::size_t {};
+  auto values = std::vector<double> {};
+  for (;;) {
+    // Only a single value larger than the buffer can fill it completely
+    if (filled == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    input.read(buffer.data() + filled,
+               static_cast<std::streamsize>(buffer.size() - filled));
+    auto const count = static_cast<std::size_t>(input.gcount());
+    filled += count;
+
+    auto const text = string_view {buffer.data(), filled};
+    values.clear();
+    auto const parsed = parseNumbers(text, values, format);
+    for (auto const value : values) {
+      handleValue(value);
+    }
+    if (parsed.invalidToken) {
+      // Reports the error
+      static_cast<void>(parseValue(*parsed.invalidToken, format));
+      return false;
+    }
+
+    auto const rest = text.substr(parsed.consumed);
+    if (count == 0) {
+      if (!rest.empty()) {
+        auto const value = parseValue(rest, format);
+        if (!value) {
+          return false;
+        }
+        handleValue(*value);
+      }
+      return true;
+    }
+    std::copy(rest.cbegin(), rest.cend(), buffer.begin());
+    filled = rest.size();
+  }
+}
+
+auto static print_summaries(std::vector<Summary> const& summaries) -> void {
+  auto const printRow = [&summaries](string_view const name, auto const field) {
+    std::cout << name;
+    for (auto const& summary : summaries) {
+      std::cout << '\t' << field(summary);
+    }
+    std::cout << '\n';
+  };
+
+  printRow("count", [](Summary const& s) { return s.count; });
+  printRow("sum", [](Summary const& s) { return s.sum; });
+  printRow("min", [](Summary const& s) { return s.min; });
+  printRow("max", [](Summary const& s) { return s.max; });
+  printRow("mean", [](Summary const& s) { return s.mean; });
+  printRow("variance", [](Summary const& s) { return s.variance; });
+  for (auto i = std::size_t {}; i < summaries.front().quantiles.size(); ++i) {
+    auto const quantile = summaries.front().quantiles[i].first;
+    printRow("p" + std::to_string(std::lround(quantile * 100.)),
+             [i](Summary const& s) { return s.quantiles[i].second; });
+  }
+}
+
 auto main(int argc, char** argv) -> int {
-  if (argc != 3 && argc != 4) {
-    print_usage(argv[0]);
+  auto aggregateOption = false;
+  auto format = NumberFormat {};
+  auto toOption = std::optional<string_view> {};
+  auto outputOption = std::optional<string_view> {};
+  auto jsonFields = std::vector<JsonField> {};
+  auto shmOption = std::optional<string_view> {};
+  auto workerCount = std::size_t {1};
+  auto args = std::vector<string_view> {};
+  for (auto i = 1; i < argc; ++i) {
+    if ("--aggregate"sv == argv[i]) {
+      aggregateOption = true;
+    } else if ("--to"sv == argv[i] && i + 1 < argc) {
+      toOption = argv[++i];
+    } else if ("--output"sv == argv[i] && i + 1 < argc) {
+      outputOption = argv[++i];
+    } else if ("--jsonl"sv == argv[i] && i + 1 < argc) {
+      auto const parts = split(argv[++i], ':');
+      if (parts.size() != 3) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      jsonFields.push_back(
+          {string {parts[0]}, string {parts[1]}, string {parts[2]}});
+    } else if ("--shm"sv == argv[i] && i + 1 < argc) {
+      shmOption = argv[++i];
+    } else if ("--workers"sv == argv[i] && i + 1 < argc) {
+      auto const count = parseNumber(argv[++i]);
+      if (count.error != std::errc {} || count.value < 1. ||
+          count.value > 256.) {
+        cerr << "[Workers] must be between 1 and 256.\n";
+        return EXIT_FAILURE;
+      }
+      workerCount = static_cast<std::size_t>(count.value);
+    } else if ("--decimal"sv == argv[i] && i + 1 < argc) {
+      format.decimalSeparator = *argv[++i];
+    } else if ("--group"sv == argv[i] && i + 1 < argc) {
+      format.groupSeparator = *argv[++i];
+    } else if ("--units"sv == argv[i] && i + 1 < argc) {
+      if (!loadCustomUnits(argv[++i])) {
+        return EXIT_FAILURE;
+      }
+    } else {
+      args.emplace_back(argv[i]);
+    }
+  }
+  // A value like 1,5 could otherwise be either 1.5 or the digits 15
+  if (format.groupSeparator != '\0' &&
+      format.groupSeparator == format.decimalSeparator) {
+    cerr << "[Group] must differ from the decimal separator.\n";
     return EXIT_FAILURE;
   }
 
-  auto const fromString = string_view {argv[1]};
-  auto const toString = string_view {argv[2]};
+  if (shmOption) {
+    if (!args.empty() || toOption || outputOption || aggregateOption ||
+        !jsonFields.empty()) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return serveSharedMemory(*shmOption, workerCount) ? EXIT_SUCCESS
+                                                      : EXIT_FAILURE;
+  }
 
-  // If the value arg is omitted or "-" get the string from stdin
-  auto const valueString = [argc, argv]() -> string {
-    if ((argc == 3) || ("-"sv == argv[3])) {
-      string tmp;
-      std::cin >> tmp;
-      return tmp;
+  if (!jsonFields.empty()) {
+    if (!args.empty() || toOption || outputOption || aggregateOption) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
     }
-    return argv[3];
-  }();
+    std::ios::sync_with_stdio(false);
+    return convertJsonLines(std::cin, std::cout, jsonFields) ? EXIT_SUCCESS
+                                                             : EXIT_FAILURE;
+  }
 
-  auto const maybeValue = convert(fromString, toString, valueString);
-  if (!maybeValue) {
+  auto const minArgs = toOption ? 1U : 2U;
+  auto const maxArgs = outputOption ? args.size() : minArgs + 1;
+  if (args.size() < minArgs || args.size() > maxArgs ||
+      (outputOption && aggregateOption)) {
+    print_usage(argv[0]);
     return EXIT_FAILURE;
   }
-  std::cout << *maybeValue << '\n';
+
+  auto const fromString = args[0];
+  auto const toString = toOption ? *toOption : args[1];
+
+  // Every target shares the parsed value, so each conversion is computed once
+  // up front and applied per value.
+  auto conversions = std::vector<Conversion> {};
+  for (auto const target : split(toString, ',')) {
+    auto const maybeConversion = conversion(fromString, target);
+    if (!maybeConversion) {
+      return EXIT_FAILURE;
+    }
+    conversions.push_back(*maybeConversion);
+  }
+
+  if (outputOption) {
+    auto const inputs = std::vector<std::filesystem::path> {
+        args.cbegin() + minArgs, args.cend()};
+    return convertFiles(inputs, *outputOption, conversions, format)
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+  }
+
+  // Every conversion is affine, so aggregating the unconverted values and
+  // converting the statistics gives the statistics of the converted values.
+  auto aggregate = std::optional<Aggregate> {};
+  if (aggregateOption) {
+    aggregate.emplace(std::vector {0.5, 0.9, 0.99});
+  }
+
+  // Rows are formatted into a buffer which is written in large chunks
+  auto out = string {};
+  auto const convertAndPrint = [&conversions, &aggregate,
+                                &out](double const value) {
+    if (aggregate) {
+      aggregate->add(value);
+      return;
+    }
+    appendRow(out, conversions, value);
+    if (out.size() >= std::size_t {1} << 16) {
+      std::cout << out;
+      out.clear();
+    }
+  };
+
+  // If the value arg is omitted or "-" convert every value from stdin
+  if (args.size() == minArgs || "-"sv == args[minArgs]) {
+    std::ios::sync_with_stdio(false);
+    if (!read_values(std::cin, format, convertAndPrint)) {
+      std::cout << out;
+      return EXIT_FAILURE;
+    }
+  } else {
+    auto const value = parseValue(args[minArgs], format);
+    if (!value) {
+      return EXIT_FAILURE;
+    }
+    convertAndPrint(*value);
+  }
+  std::cout << out;
+
+  if (aggregate) {
+    auto const summary = aggregate->summary();
+    auto summaries = std::vector<Summary> {};
+    for (auto const& conversion : conversions) {
+      summaries.push_back(summary.converted(conversion));
+    }
+    print_summaries(summaries);
+  }
 }
@@ -0,0 +1,163 @@
+#include "convertfromstrings.hpp"
+#include "parsenumbers.hpp"
+#include "sharedmemory.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace std::string_view_literals;
+using std::cerr;
+using std::string;
+using std::string_view;
+
+auto static print_usage(string_view const programName) -> void {
+  cerr << "Usage: " << programName << " [Name] [From] [To] [Value | -]\n";
+  cerr << "       " << programName << " --bench [Count] [Name] [From] [To]\n\n";
+  cerr << "Options:\n"
+          "\t--units [File]\tAlso use the units defined in [File]\n\n";
+  cerr << "Converts values through a JConverter-shell --shm [Name] server. "
+          "With\n--bench, converts [Count] values and reports the throughput "
+          "and\nthe latency of single value round trips.\n";
+}
+
+// returns false if the server shut down during the benchmark
+auto static benchmark(SharedMemoryClient& client, std::uint32_t const pairId,
+                      std::size_t const count) -> bool {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
+  auto const pairIds = std::vector<std::uint32_t>(count, pairId);
+  auto values = std::vector<double>(count);
+  for (auto i = std::size_t {}; i < count; ++i) {
+    values[i] = static_cast<double>(i);
+  }
+  auto results = std::vector<double>(count);
+
+  auto const start = Clock::now();
+  if (!client.convert(pairIds.data(), values.data(), results.data(), count)) {
+    return false;
+  }
+  auto const elapsed = Seconds {Clock::now() - start}.count();
+  std::cout << "throughput\t" << static_cast<double>(count) / elapsed
+            << " values/s\n";
+
+  auto latencies = std::vector<double>(std::min<std::size_t>(count, 10'000));
+  for (auto& latency : latencies) {
+    auto result = 0.;
+    auto const roundTripStart = Clock::now();
+    if (!client.convert(&pairId, values.data(), &result, 1)) {
+      return false;
+    }
+    latency = std::chrono::duration<double, std::micro> {Clock::now() -
+                                                         roundTripStart}
+                  .count();
+  }
+  if (latencies.empty()) {
+    return true;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto const percentile = [&latencies](double const quantile) {
+    return latencies[static_cast<std::size_t>(
+        quantile * static_cast<double>(latencies.size() - 1))];
+  };
+  std::cout << "latency p50\t" << percentile(0.5) << " us\n";
+  std::cout << "latency p99\t" << percentile(0.99) << " us\n";
+  return true;
+}
+
+auto main(int argc, char** argv) -> int {
+  auto args = std::vector<string_view> {};
+  auto benchCount = std::size_t {};
+  for (auto i = 1; i < argc; ++i) {
+    if ("--bench"sv == argv[i] && i + 1 < argc) {
+      auto const count = parseNumber(argv[++i]);
+      if (count.error != std::errc {} || count.value < 1.) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      benchCount = static_cast<std::size_t>(count.value);
+    } else if ("--units"sv == argv[i] && i + 1 < argc) {
+      if (!loadCustomUnits(argv[++i])) {
+        return EXIT_FAILURE;
+      }
+    } else {
+      args.emplace_back(argv[i]);
+    }
+  }
+  if (args.size() != 3 && (benchCount != 0 || args.size() != 4)) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto const fromUnit = stringToUnit(args[1]);
+  auto const toUnit = stringToUnit(args[2]);
+  if (!fromUnit || !toUnit) {
+    cerr << "[From] or [To] is not a valid unit.\n";
+    return EXIT_FAILURE;
+  }
+  auto const pairId = sharedPairId(fromUnit->unit, toUnit->unit);
+  if (!pairId) {
+    cerr << "ERR: Units are of different types.\n";
+    return EXIT_FAILURE;
+  }
+
+  if (benchCount != 0) {
+    auto client = SharedMemoryClient::connect(args[0]);
+    if (!client) {
+      return EXIT_FAILURE;
+    }
+    if (!benchmark(*client, *pairId, benchCount)) {
+      cerr << "[Shared memory] The server shut down.\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // The input is read before connecting so that the channel isn't held while
+  // waiting for stdin
+  auto values = std::vector<double> {};
+  if (args.size() == 3 || args[3] == "-"sv) {
+    auto const input = string {std::istreambuf_iterator<char> {std::cin},
+                               std::istreambuf_iterator<char> {}};
+    auto const parsed = parseNumbers(input + '\n', values);
+    if (parsed.invalidToken) {
+      static_cast<void>(parseValue(*parsed.invalidToken));
+      return EXIT_FAILURE;
+    }
+  } else {
+    auto const value = parseValue(args[3]);
+    if (!value) {
+      return EXIT_FAILURE;
+    }
+    values.push_back(*value);
+  }
+
+  auto client = SharedMemoryClient::connect(args[0]);
+  if (!client) {
+    return EXIT_FAILURE;
+  }
+
+  // Custom units are converted as their built-in unit on the server
+  for (auto& value : values) {
+    value *= fromUnit->scale;
+  }
+  auto const pairIds = std::vector<std::uint32_t>(values.size(), *pairId);
+  auto results = std::vector<double>(values.size());
+  if (!client->convert(pairIds.data(), values.data(), results.data(),
+                       values.size())) {
+    cerr << "[Shared memory] The server shut down.\n";
+    return EXIT_FAILURE;
+  }
+  for (auto const result : results) {
+    std::cout << result / toUnit->scale << '\n';
+  }
+}
@@ -0,0 +1,414 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <numeric>
+#include <optional>
+#include <ratio>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace impl {
+
+template <typename Quantity>
+auto constexpr ratio_of() -> Ratio {
+  return {Quantity::period::num, Quantity::period::den};
+}
+
+// Sizes of the units in their type's base unit
+auto constexpr period(Unit::Distance const unit) -> Ratio {
+  using namespace Distance;
+  switch (unit) {
+  case Unit::Distance::millimeter:
+    return ratio_of<Millimeters>();
+  case Unit::Distance::centimeter:
+    return ratio_of<Centimeters>();
+  case Unit::Distance::decimeter:
+    return ratio_of<Decimeters>();
+  case Unit::Distance::meter:
+    return ratio_of<Meters>();
+  case Unit::Distance::kilometer:
+    return ratio_of<Kilometers>();
+
+  case Unit::Distance::lightyear:
+    return ratio_of<Lightyears>();
+
+  case Unit::Distance::thou:
+    return ratio_of<Imperial::Thou>();
+  case Unit::Distance::barleycorn:
+    return ratio_of<Imperial::Barleycorns>();
+  case Unit::Distance::inch:
+    return ratio_of<Imperial::Inches>();
+  case Unit::Distance::foot:
+    return ratio_of<Imperial::Feet>();
+  case Unit::Distance::yard:
+    return ratio_of<Imperial::Yards>();
+  case Unit::Distance::furlong:
+    return ratio_of<Imperial::Furlongs>();
+  case Unit::Distance::mile:
+    return ratio_of<Imperial::Miles>();
+  case Unit::Distance::league:
+    return ratio_of<Imperial::Leagues>();
+
+  case Unit::Distance::fathom:
+    return ratio_of<Imperial::Fathoms>();
+  case Unit::Distance::cable:
+    return ratio_of<Imperial::Cables>();
+  case Unit::Distance::nauticalMile:
+    return ratio_of<Imperial::NauticleMiles>();
+
+  case Unit::Distance::link:
+    return ratio_of<Imperial::Links>();
+  case Unit::Distance::rod:
+    return ratio_of<Imperial::Rods>();
+  }
+  // Unreachable unless not all Unit::Distance enumerators are covered in the
+  // switch.
+  std::terminate();
+}
+
+auto constexpr period(Unit::Weight const unit) -> Ratio {
+  using namespace Weight;
+  switch (unit) {
+  case Unit::Weight::milligram:
+    return ratio_of<Milligrams>();
+  case Unit::Weight::gram:
+    return ratio_of<Grams>();
+  case Unit::Weight::hectogram:
+    return ratio_of<Hectograms>();
+  case Unit::Weight::kilogram:
+    return ratio_of<Kilograms>();
+  case Unit::Weight::tonne:
+    return ratio_of<Tonnes>();
+
+  case Unit::Weight::grain:
+    return ratio_of<Imperial::Grains>();
+  case Unit::Weight::drachm:
+    return ratio_of<Imperial::Drachms>();
+  case Unit::Weight::ounce:
+    return ratio_of<Imperial::Ounces>();
+  case Unit::Weight::lb:
+    return ratio_of<Imperial::Pounds>();
+  case Unit::Weight::stone:
+    return ratio_of<Imperial::Stones>();
+  case Unit::Weight::quarter:
+    return ratio_of<Imperial::Quarters>();
+  case Unit::Weight::hundredweight:
+    return ratio_of<Imperial::Hundredweights>();
+  case Unit::Weight::ton:
+    return ratio_of<Imperial::Tons>();
+  case Unit::Weight::slug:
+    return ratio_of<Imperial::Slugs>();
+  }
+  // Unreachable unless not all Unit::Weight enumerators are covered in the
+  // switch.
+  std::terminate();
+}
+
+auto constexpr period(Unit::Volume const unit) -> Ratio {
+  using namespace Volume;
+  switch (unit) {
+  case Unit::Volume::milliliter:
+    return ratio_of<Milliliters>();
+  case Unit::Volume::centiliter:
+    return ratio_of<Centiliters>();
+  case Unit::Volume::liter:
+    return ratio_of<Liters>();
+  case Unit::Volume::fluidOunce:
+    return ratio_of<Imperial::FluidOunces>();
+  case Unit::Volume::gill:
+    return ratio_of<Imperial::Gills>();
+  case Unit::Volume::pint:
+    return ratio_of<Imperial::Pints>();
+  case Unit::Volume::quart:
+    return ratio_of<Imperial::Quarts>();
+  case Unit::Volume::gallon:
+    return ratio_of<Imperial::Gallons>();
+  }
+  // Unreachable unless not all Unit::Volume enumerators are covered in the
+  // switch.
+  std::terminate();
+}
+
+// Number of enumerators of each unit type
+template <typename Enum>
+std::size_t constexpr unit_count = 0;
+template <>
+inline std::size_t constexpr unit_count<Unit::Temperature> =
+    temperatureStrings.size();
+template <>
+inline std::size_t constexpr unit_count<Unit::Distance> =
+    distanceStrings.size();
+template <>
+inline std::size_t constexpr unit_count<Unit::Weight> = weightStrings.size();
+template <>
+inline std::size_t constexpr unit_count<Unit::Volume> = volumeStrings.size();
+
+// Whether std::ratio_divide can divide the ratios without overflowing. Mirrors
+// the reduction std::ratio_multiply performs before multiplying.
+auto constexpr divisible(Ratio const dividend, Ratio const divisor) -> bool {
+  auto const numGcd = std::gcd(dividend.num, divisor.num);
+  auto const denGcd = std::gcd(dividend.den, divisor.den);
+  auto const fits = [](std::intmax_t const a, std::intmax_t const b) {
+    return a <= INTMAX_MAX / b;
+  };
+  return fits(dividend.num / numGcd, divisor.den / denGcd) &&
+         fits(dividend.den / denGcd, divisor.num / numGcd);
+}
+
+template <typename Enum, Enum From, Enum To>
+auto constexpr kernel_conversion() -> Conversion {
+  if constexpr (std::is_same_v<Enum, Unit::Temperature>) {
+    return conversion(From, To);
+  } else {
+    auto constexpr from = period(From);
+    auto constexpr to = period(To);
+    if constexpr (divisible(from, to)) {
+      using Factor = std::ratio_divide<std::ratio<from.num, from.den>,
+                                       std::ratio<to.num, to.den>>;
+      return {static_cast<double>(Factor::num) /
+                  static_cast<double>(Factor::den),
+              0.};
+    } else {
+      // e.g. light-years to thou, whose exact ratio doesn't fit in intmax_t
+      return {(static_cast<double>(from.num) / static_cast<double>(from.den)) /
+                  (static_cast<double>(to.num) / static_cast<double>(to.den)),
+              0.};
+    }
+  }
+}
+
+template <typename Enum, Enum From, Enum To>
+auto constexpr convert_scalar(double const value) -> double {
+  auto constexpr conversion = kernel_conversion<Enum, From, To>();
+  if constexpr (conversion.offset == 0.) {
+    return value * conversion.scale;
+  } else {
+    return value * conversion.scale + conversion.offset;
+  }
+}
+
+template <typename Enum, Enum From, Enum To>
+auto convert_block(double const* const values, double* const results,
+                   std::size_t const count) -> void {
+  for (auto i = std::size_t {}; i < count; ++i) {
+    results[i] = convert_scalar<Enum, From, To>(values[i]);
+  }
+}
+
+template <typename Enum, std::size_t Count, std::size_t... Pair>
+auto constexpr kernel_table(std::index_sequence<Pair...> /*unused*/)
+    -> std::array<Kernel, sizeof...(Pair)> {
+  return {Kernel {&convert_scalar<Enum, static_cast<Enum>(Pair / Count),
+                                  static_cast<Enum>(Pair % Count)>,
+                  &convert_block<Enum, static_cast<Enum>(Pair / Count),
+                                 static_cast<Enum>(Pair % Count)>}...};
+}
+
+// kernels<Enum>[from * unit_count<Enum> + to] converts from one unit of type
+// Enum to another
+template <typename Enum>
+inline auto constexpr kernels = kernel_table<Enum, unit_count<Enum>>(
+    std::make_index_sequence<unit_count<Enum> * unit_count<Enum>> {});
+
+struct KernelTable {
+  Kernel const* kernels;
+  std::size_t unitCount;
+  // pair_index of the table's first pair
+  std::size_t firstPair;
+};
+
+template <typename Enum>
+auto constexpr kernel_table_of() -> KernelTable {
+  return {kernels<Enum>.data(), unit_count<Enum>, 0};
+}
+
+// The kernel tables of every unit type, in the order of Unit::Variant
+inline auto constexpr kernel_tables = [] {
+  auto tables = std::array {
+      kernel_table_of<Unit::Temperature>(), kernel_table_of<Unit::Distance>(),
+      kernel_table_of<Unit::Weight>(), kernel_table_of<Unit::Volume>()};
+  auto firstPair = std::size_t {};
+  for (auto& table : tables) {
+    table.firstPair = firstPair;
+    firstPair += table.unitCount * table.unitCount;
+  }
+  return tables;
+}();
+static_assert(kernel_tables.size() == std::variant_size_v<Unit::Variant>,
+              "kernel_tables must be updated to reflect a change in "
+              "Unit::Variant's template arguments");
+
+// Number of pairs of units of the same type
+inline auto constexpr pair_count =
+    kernel_tables.back().firstPair +
+    kernel_tables.back().unitCount * kernel_tables.back().unitCount;
+
+// Numbers the pairs of units of the same type from 0 to pair_count - 1, e.g.
+// for bucketing values by their pair. The units must be of the same type.
+auto constexpr pair_index(UnitId const fromUnit, UnitId const toUnit)
+    -> std::size_t {
+  auto const& table = kernel_tables[fromUnit.typeIndex()];
+  return table.firstPair + fromUnit.unitIndex() * table.unitCount +
+         toUnit.unitIndex();
+}
+
+auto constexpr magnitude(double const value) -> double {
+  return value < 0. ? -value : value;
+}
+
+// Whether every kernel gives the same results as convert, up to rounding
+template <typename Enum>
+auto constexpr kernels_match_convert() -> bool {
+  std::array constexpr values {1., -40., 1234.5};
+  for (auto from = std::size_t {}; from < unit_count<Enum>; ++from) {
+    for (auto to = std::size_t {}; to < unit_count<Enum>; ++to) {
+      for (auto const value : values) {
+        auto const expected =
+            convert(static_cast<Enum>(from), static_cast<Enum>(to), value);
+        auto const actual =
+            kernels<Enum>[from * unit_count<Enum> + to].scalar(value);
+        auto const tolerance =
+            1e-12 * (magnitude(expected) > 1. ? magnitude(expected) : 1.);
+        if (magnitude(actual - expected) > tolerance) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static_assert(kernels_match_convert<Unit::Temperature>(),
+              "Temperature kernels don't match convert");
+static_assert(kernels_match_convert<Unit::Distance>(),
+              "Distance kernels don't match convert");
+static_assert(kernels_match_convert<Unit::Weight>(),
+              "Weight kernels don't match convert");
+static_assert(kernels_match_convert<Unit::Volume>(),
+              "Volume kernels don't match convert");
+
+// Number of values gathered into a contiguous block before running a kernel
+// on strided values. Small enough to stay in L1 while being converted.
+std::size_t constexpr strided_block_size = 256;
+
+// Values are addressed by offset from the first one so that no pointer is
+// formed past the last value.
+inline auto convert_strided(Kernel const& kernel,
+                            unsigned char const* const values,
+                            std::size_t const valueStride,
+                            unsigned char* const results,
+                            std::size_t const resultStride,
+                            std::size_t const count) -> void {
+  auto block = std::array<double, strided_block_size> {};
+  for (auto done = std::size_t {}; done < count;) {
+    auto const size = std::min(count - done, strided_block_size);
+    // memcpy since the fields of packed records may be misaligned
+    for (auto i = std::size_t {}; i < size; ++i) {
+      std::memcpy(&block[i], values + (done + i) * valueStride,
+                  sizeof(double));
+    }
+    kernel.block(block.data(), block.data(), size);
+    for (auto i = std::size_t {}; i < size; ++i) {
+      std::memcpy(results + (done + i) * resultStride, &block[i],
+                  sizeof(double));
+    }
+    done += size;
+  }
+}
+
+[[nodiscard]] inline auto is_double_aligned(void const* const pointer)
+    -> bool {
+  return reinterpret_cast<std::uintptr_t>(pointer) % alignof(double) == 0;
+}
+
+} // namespace impl
+
+// Looks up the kernel specialized for converting between the units. Its
+// conversion factor is folded in at compile time, so once looked up converting
+// a value is a single indirect call.
+// returns empty optional if units are of different types (e.g. distance and
+// temperature)
+auto constexpr kernel(UnitId const fromUnit, UnitId const toUnit)
+    -> std::optional<Kernel> {
+  if (fromUnit.typeIndex() != toUnit.typeIndex()) {
+    return std::nullopt;
+  }
+  auto const& table = impl::kernel_tables[fromUnit.typeIndex()];
+  return table.kernels[fromUnit.unitIndex() * table.unitCount +
+                       toUnit.unitIndex()];
+}
+
+// returns empty optional if units are of different types (e.g. distance and
+// temperature)
+auto constexpr convert(UnitId const fromUnit, UnitId const toUnit,
+                       double const value) -> std::optional<double> {
+  auto const maybeKernel = kernel(fromUnit, toUnit);
+  if (!maybeKernel) {
+    return std::nullopt;
+  }
+  return maybeKernel->scalar(value);
+}
+
+// Converts count values at once. values and results may be the same array.
+// returns false if units are of different types (e.g. distance and
+// temperature)
+inline auto convert(UnitId const fromUnit, UnitId const toUnit,
+                    double const* const values, double* const results,
+                    std::size_t const count) -> bool {
+  auto const maybeKernel = kernel(fromUnit, toUnit);
+  if (!maybeKernel) {
+    return false;
+  }
+  maybeKernel->block(values, results, count);
+  return true;
+}
+
+// Converts count doubles spaced valueStride bytes apart, such as one field of
+// an array of records, into doubles spaced resultStride bytes apart. e.g.
+// convertStrided(kg, lb, &records[0].weight, sizeof(Record),
+//                &records[0].weight, sizeof(Record), records.size())
+// The doubles don't need to be aligned, so the fields of packed records can be
+// passed as byte pointers, e.g. bytes + offsetof(Record, weight).
+// The values are gathered into small contiguous blocks, so only one field is
+// converted without copying the records.
+// returns false if units are of different types (e.g. distance and
+// temperature)
+inline auto convertStrided(UnitId const fromUnit, UnitId const toUnit,
+                           void const* const values,
+                           std::size_t const valueStride, void* const results,
+                           std::size_t const resultStride,
+                           std::size_t const count) -> bool {
+  auto const maybeKernel = kernel(fromUnit, toUnit);
+  if (!maybeKernel) {
+    return false;
+  }
+  if (valueStride == sizeof(double) && resultStride == sizeof(double) &&
+      impl::is_double_aligned(values) && impl::is_double_aligned(results)) {
+    maybeKernel->block(static_cast<double const*>(values),
+                       static_cast<double*>(results), count);
+    return true;
+  }
+  impl::convert_strided(*maybeKernel,
+                        static_cast<unsigned char const*>(values), valueStride,
+                        static_cast<unsigned char*>(results), resultStride,
+                        count);
+  return true;
+}
+
+// Converts count doubles spaced stride bytes apart in place
+// returns false if units are of different types (e.g. distance and
+// temperature)
+inline auto convertStrided(UnitId const fromUnit, UnitId const toUnit,
+                           void* const values, std::size_t const stride,
+                           std::size_t const count) -> bool {
+  return convertStrided(fromUnit, toUnit, values, stride, values, stride,
+                        count);
+}
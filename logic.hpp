@@ -2,9 +2,13 @@
 
 #include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
 #include <optional>
 #include <ratio>
 #include <string_view>
+#include <type_traits>
 #include <variant>
 
 namespace Distance {
@@ -132,6 +136,26 @@ using Tonnes = Weight<double, std::mega>;
 
 } // namespace Weight
 
+// An affine conversion between two units of the same type. Converting a value
+// with a precomputed Conversion is a single multiply-add, which makes it
+// suitable for converting many values between the same pair of units.
+struct Conversion {
+  double scale {1.};
+  double offset {};
+
+  [[nodiscard]] auto constexpr operator()(double const value) const noexcept
+      -> double {
+    return value * scale + offset;
+  }
+};
+
+// Conversion functions specialized for a pair of built-in units (see
+// kernels.hpp). block converts count values at once.
+struct Kernel {
+  double (*scalar)(double value);
+  void (*block)(double const* values, double* results, std::size_t count);
+};
+
 class Unit {
 public:
   enum class Type { temperature, distance, weight, volume };
@@ -229,9 +253,15 @@ public:
     }();
   }
 
+  [[nodiscard]] auto constexpr variant() const noexcept -> Variant const& {
+    return m_unit;
+  }
+
 private:
   friend auto constexpr convert(Unit const& fromUnit, Unit const& toUnit,
                                 double value) -> std::optional<double>;
+  friend auto constexpr conversion(Unit const& fromUnit, Unit const& toUnit)
+      -> std::optional<Conversion>;
 
   [[nodiscard]] auto constexpr type() const noexcept -> Type { return m_type; }
 
@@ -291,6 +321,97 @@ std::array constexpr volumeStrings {
     std::string_view {"Quart"},      std::string_view {"Gallon"},
 };
 
+// A unit packed into 16 bits: the index of its type in Unit::Variant in the
+// high byte and its enumerator in the low byte. Unlike Unit it's trivially
+// copyable and small enough to store alongside every value, and converting
+// between two UnitIds is a table lookup (see kernels.hpp).
+// A default constructed UnitId is Celsius.
+class UnitId {
+public:
+  UnitId() = default;
+
+  // Implicit since every Unit has a UnitId, so functions taking UnitIds also
+  // take Units
+  constexpr UnitId(Unit const& unit)
+      : m_bits {static_cast<std::uint16_t>(
+            unit.variant().index() << 8U |
+            std::visit(
+                [](auto const enumerator) {
+                  return static_cast<std::size_t>(enumerator);
+                },
+                unit.variant()))} {}
+
+  // returns empty optional if bits don't encode a unit
+  [[nodiscard]] static auto constexpr fromBits(std::uint16_t const bits)
+      -> std::optional<UnitId> {
+    auto const type = std::size_t {bits} >> 8U;
+    auto const unit = std::size_t {bits} & 0xFFU;
+    if (type < unitCounts.size() && unit < unitCounts[type]) {
+      return UnitId {bits};
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] auto constexpr bits() const noexcept -> std::uint16_t {
+    return m_bits;
+  }
+
+  // Index of the unit's type in Unit::Variant
+  [[nodiscard]] auto constexpr typeIndex() const noexcept -> std::size_t {
+    return m_bits >> 8U;
+  }
+
+  // The unit's enumerator value
+  [[nodiscard]] auto constexpr unitIndex() const noexcept -> std::size_t {
+    return m_bits & 0xFFU;
+  }
+
+  [[nodiscard]] auto constexpr unit() const -> Unit {
+    // The order of Unit::Variant's template arguments determines the type
+    static_assert(std::variant_size_v<Unit::Variant> == 4,
+                  "UnitId must be updated to reflect a change in "
+                  "Unit::Variant's number of template arguments");
+    auto const index = static_cast<int>(unitIndex());
+    switch (typeIndex()) {
+    case 0:
+      return Unit {Unit::Temperature {index}};
+    case 1:
+      return Unit {Unit::Distance {index}};
+    case 2:
+      return Unit {Unit::Weight {index}};
+    case 3:
+      return Unit {Unit::Volume {index}};
+    default:
+      // Unreachable unless m_bits doesn't encode a unit, which the
+      // constructors prevent.
+      std::terminate();
+    }
+  }
+
+  [[nodiscard]] friend auto constexpr operator==(UnitId const a,
+                                                 UnitId const b) -> bool {
+    return a.m_bits == b.m_bits;
+  }
+
+  [[nodiscard]] friend auto constexpr operator!=(UnitId const a,
+                                                 UnitId const b) -> bool {
+    return a.m_bits != b.m_bits;
+  }
+
+private:
+  // Number of enumerators of each type, in the order of Unit::Variant
+  static std::array constexpr unitCounts {
+      temperatureStrings.size(), distanceStrings.size(), weightStrings.size(),
+      volumeStrings.size()};
+
+  explicit constexpr UnitId(std::uint16_t const bits) : m_bits {bits} {}
+
+  std::uint16_t m_bits {};
+};
+
+static_assert(sizeof(UnitId) == 2 && std::is_trivially_copyable_v<UnitId>,
+              "UnitId must stay compact enough to store per value");
+
 namespace impl {
 
 // Temperatures
@@ -310,6 +431,73 @@ auto constexpr kelvin_to_celsius(double const kelvin) -> double {
   return kelvin - 273.15;
 }
 
+struct Ratio {
+  std::intmax_t num;
+  std::intmax_t den;
+};
+
+auto constexpr reduce(Ratio const ratio) -> Ratio {
+  auto const divisor = std::gcd(ratio.num, ratio.den);
+  return {ratio.num / divisor, ratio.den / divisor};
+}
+
+auto constexpr operator*(Ratio const a, Ratio const b) -> Ratio {
+  return reduce({a.num * b.num, a.den * b.den});
+}
+
+auto constexpr operator+(Ratio const a, Ratio const b) -> Ratio {
+  return reduce({a.num * b.den + b.num * a.den, a.den * b.den});
+}
+
+auto constexpr to_double(Ratio const ratio) -> double {
+  return static_cast<double>(ratio.num) / static_cast<double>(ratio.den);
+}
+
+// value * scale + offset with exact coefficients, so that composing two of
+// them doesn't round (e.g. celsius to fahrenheit has an offset of exactly 32)
+struct ExactConversion {
+  Ratio scale;
+  Ratio offset;
+};
+
+// Conversion from the given temperature unit to kelvin
+auto constexpr to_kelvin(Unit::Temperature const fromUnit) -> ExactConversion {
+  switch (fromUnit) {
+  case Unit::Temperature::kelvin:
+    return {{1, 1}, {0, 1}};
+  case Unit::Temperature::celsius:
+    return {{1, 1}, {27'315, 100}};
+  case Unit::Temperature::fahrenheit:
+    return {{5, 9}, Ratio {45'967, 100} * Ratio {5, 9}};
+  }
+  // Unreachable unless not all Unit::Temperature enumerators are covered in the
+  // switch.
+  std::terminate();
+}
+
+// Conversion from kelvin to the given temperature unit
+auto constexpr from_kelvin(Unit::Temperature const toUnit) -> ExactConversion {
+  switch (toUnit) {
+  case Unit::Temperature::kelvin:
+    return {{1, 1}, {0, 1}};
+  case Unit::Temperature::celsius:
+    return {{1, 1}, {-27'315, 100}};
+  case Unit::Temperature::fahrenheit:
+    return {{9, 5}, {-45'967, 100}};
+  }
+  // Unreachable unless not all Unit::Temperature enumerators are covered in the
+  // switch.
+  std::terminate();
+}
+
+auto constexpr conversion(Unit::Temperature const fromUnit,
+                          Unit::Temperature const toUnit) -> Conversion {
+  auto const toKelvin = to_kelvin(fromUnit);
+  auto const fromKelvin = from_kelvin(toUnit);
+  return {to_double(toKelvin.scale * fromKelvin.scale),
+          to_double(toKelvin.offset * fromKelvin.scale + fromKelvin.offset)};
+}
+
 auto constexpr to_meters(Unit::Distance const fromUnit, double const value)
     -> Distance::Meters {
   using namespace Distance;
@@ -624,3 +812,22 @@ auto constexpr convert(Unit const& fromUnit, Unit const& toUnit,
   // switch.
   std::terminate();
 }
+
+// Precomputes the conversion between two units so that it can be applied to
+// many values without repeating the unit dispatch.
+// returns empty optional if units are of different types (e.g. distance and
+// temperature)
+auto constexpr conversion(Unit const& fromUnit, Unit const& toUnit)
+    -> std::optional<Conversion> {
+  if (fromUnit.type() != toUnit.type()) {
+    return std::nullopt;
+  }
+
+  if (fromUnit.type() == Unit::Type::temperature) {
+    return impl::conversion(fromUnit.temperature(), toUnit.temperature());
+  }
+
+  // Every other unit type is proportional, so the conversion is fully
+  // described by the converted value of 1.
+  return Conversion {*convert(fromUnit, toUnit, 1.), 0.};
+}
@@ -0,0 +1,148 @@
+#include "parsenumbers.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using std::string_view;
+
+namespace {
+
+auto is_space(char const c) -> bool {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+auto is_digit(char const c) -> bool { return c >= '0' && c <= '9'; }
+
+// Parses a number in the default format
+auto parse(string_view str) -> ParsedNumber {
+  // std::from_chars doesn't accept a leading plus sign
+  if (!str.empty() && str.front() == '+') {
+    str.remove_prefix(1);
+    if (!str.empty() && str.front() == '-') {
+      return {0., std::errc::invalid_argument};
+    }
+  }
+
+  auto value = 0.;
+  auto const* const last = str.data() + str.size();
+  auto const [end, error] = std::from_chars(str.data(), last, value);
+  if (error != std::errc {}) {
+    return {0., error};
+  }
+  if (end != last) {
+    return {0., std::errc::invalid_argument};
+  }
+  return {value, {}};
+}
+
+// Rewrites str in the default format into out, which must have room for at
+// least str.size() characters. Group separators are only accepted between
+// groups of three digits in the integer part, after one to three leading
+// digits (e.g. 1,234,567 but not 12,5 or 1,0,0).
+// returns the number of characters written or empty optional if str doesn't
+// follow format
+auto normalize(string_view const str, NumberFormat const& format,
+               char* const out) -> std::optional<std::size_t> {
+  auto size = std::size_t {};
+  auto inIntegerPart = true;
+  auto grouped = false;
+  // Digits since the start of the integer part or the last group separator
+  auto groupDigits = std::size_t {};
+  // Whether the integer part so far ends with a complete group
+  auto const groupsComplete = [&] { return !grouped || groupDigits == 3; };
+
+  for (auto const c : str) {
+    if (format.groupSeparator != '\0' && c == format.groupSeparator) {
+      if (!inIntegerPart || groupDigits == 0 || groupDigits > 3 ||
+          !groupsComplete()) {
+        return std::nullopt;
+      }
+      grouped = true;
+      groupDigits = 0;
+      continue;
+    }
+    if (inIntegerPart && is_digit(c)) {
+      ++groupDigits;
+      out[size++] = c;
+      continue;
+    }
+    if (c == '.' && c != format.decimalSeparator) {
+      // Only valid as the decimal separator, which it isn't in this format
+      return std::nullopt;
+    }
+    if (inIntegerPart && (c == format.decimalSeparator || c == 'e' ||
+                          c == 'E')) {
+      if (!groupsComplete()) {
+        return std::nullopt;
+      }
+      inIntegerPart = false;
+    }
+    out[size++] = c == format.decimalSeparator ? '.' : c;
+  }
+  if (inIntegerPart && !groupsComplete()) {
+    return std::nullopt;
+  }
+  return size;
+}
+
+} // namespace
+
+auto parseNumber(string_view const str, NumberFormat const& format)
+    -> ParsedNumber {
+  if (format.decimalSeparator == '.' && format.groupSeparator == '\0') {
+    return parse(str);
+  }
+
+  // Numbers are rarely long enough to not fit in the stack buffer
+  auto stackBuffer = std::array<char, 128> {};
+  auto heapBuffer = std::string {};
+  auto* buffer = stackBuffer.data();
+  if (str.size() > stackBuffer.size()) {
+    heapBuffer.resize(str.size());
+    buffer = heapBuffer.data();
+  }
+
+  auto const size = normalize(str, format, buffer);
+  if (!size) {
+    return {0., std::errc::invalid_argument};
+  }
+  return parse({buffer, *size});
+}
+
+auto parseNumbers(string_view const buffer, std::vector<double>& values,
+                  NumberFormat const& format) -> ParsedNumbers {
+  auto result = ParsedNumbers {};
+  auto pos = std::size_t {};
+  for (;;) {
+    while (pos < buffer.size() && is_space(buffer[pos])) {
+      ++pos;
+    }
+    auto end = pos;
+    while (end < buffer.size() && !is_space(buffer[end])) {
+      ++end;
+    }
+    if (end == buffer.size()) {
+      // The last token may continue in the next buffer
+      break;
+    }
+
+    auto const token = buffer.substr(pos, end - pos);
+    auto const parsed = parseNumber(token, format);
+    if (parsed.error != std::errc {}) {
+      result.invalidToken = token;
+      result.error = parsed.error;
+      break;
+    }
+    values.push_back(parsed.value);
+    pos = end;
+  }
+  result.consumed = pos;
+  return result;
+}
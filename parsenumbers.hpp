@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// How numbers are written. Parsing with the default format doesn't copy the
+// string, other formats are normalized into a small buffer first.
+struct NumberFormat {
+  char decimalSeparator {'.'};
+  // Separator between groups of digits in the integer part (e.g. the ',' in
+  // "1,000.5"), or '\0' if digits aren't grouped. Must differ from
+  // decimalSeparator.
+  char groupSeparator {};
+};
+
+struct ParsedNumber {
+  double value {};
+  // std::errc::invalid_argument if the string isn't a number and
+  // std::errc::result_out_of_range if it's out of range for a double.
+  std::errc error {};
+};
+
+// Parses the whole string as a decimal or scientific notation number. Unlike
+// std::stod this doesn't depend on the locale, doesn't accept leading
+// whitespace or trailing characters and the result is always correctly
+// rounded.
+[[nodiscard]] auto parseNumber(std::string_view str,
+                               NumberFormat const& format = {})
+    -> ParsedNumber;
+
+struct ParsedNumbers {
+  // Number of characters of the buffer that were parsed. Parsing stops at the
+  // last whitespace character so that a value split between two reads isn't
+  // parsed until the rest of it has been read.
+  std::size_t consumed {};
+  // The first token that isn't a number, if any
+  std::optional<std::string_view> invalidToken;
+  std::errc error {};
+};
+
+// Parses every whitespace terminated number in buffer and appends them to
+// values.
+auto parseNumbers(std::string_view buffer, std::vector<double>& values,
+                  NumberFormat const& format = {}) -> ParsedNumbers;
@@ -0,0 +1,551 @@
+#include "sharedmemory.hpp"
+
+#include "convertbatch.hpp"
+#include "logic.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JCONVERTER_HAS_SHM 1
+#endif
+
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+using std::cerr;
+using std::string;
+using std::string_view;
+
+auto sharedPairId(UnitId const fromUnit, UnitId const toUnit)
+    -> std::optional<std::uint32_t> {
+  if (fromUnit.typeIndex() != toUnit.typeIndex()) {
+    return std::nullopt;
+  }
+  return static_cast<std::uint32_t>(fromUnit.bits()) << 16U | toUnit.bits();
+}
+
+#ifdef JCONVERTER_HAS_SHM
+
+namespace {
+
+std::uint32_t constexpr segmentMagic = 0x4A43'5348;
+std::size_t constexpr ringCapacity = 4096;
+std::size_t constexpr batchSize = 256;
+auto constexpr sleepTimeout = std::chrono::milliseconds {100};
+
+struct Request {
+  std::uint32_t pairId;
+  double value;
+};
+
+// The atomics are shared between processes, which only works if they don't
+// need a lock.
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free &&
+                  std::atomic<std::uint64_t>::is_always_lock_free,
+              "Shared memory requires lock-free atomics");
+
+// Sleeps until the given word changes, at most for sleepTimeout so that
+// shutdowns and crashed peers are noticed.
+auto wait_on(std::atomic<std::uint32_t>& word, std::uint32_t const expected)
+    -> void {
+#ifdef __linux__
+  auto const seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(sleepTimeout);
+  auto const timeout = timespec {
+      seconds.count(),
+      std::chrono::duration_cast<std::chrono::nanoseconds>(sleepTimeout -
+                                                           seconds)
+          .count()};
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT,
+          expected, &timeout, nullptr, 0);
+#else
+  static_cast<void>(word);
+  static_cast<void>(expected);
+  std::this_thread::sleep_for(std::chrono::microseconds {100});
+#endif
+}
+
+auto wake(std::atomic<std::uint32_t>& word) -> void {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE,
+          INT32_MAX, nullptr, nullptr, 0);
+#else
+  static_cast<void>(word);
+#endif
+}
+
+// Lets one side of a ring sleep until the other side has made progress. The
+// other side only makes a system call if someone is sleeping.
+struct Event {
+  template <typename Ready>
+  auto wait(Ready&& ready) -> void {
+    for (auto spin = 0; spin < 4096; ++spin) {
+      if (ready()) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    auto const ticket = signal.load();
+    sleeping.store(1);
+    if (!ready()) {
+      wait_on(signal, ticket);
+    }
+    sleeping.store(0);
+  }
+
+  auto notify(bool const force = false) -> void {
+    if (force || sleeping.load() != 0) {
+      signal.fetch_add(1);
+      wake(signal);
+    }
+  }
+
+  std::atomic<std::uint32_t> signal {};
+  std::atomic<std::uint32_t> sleeping {};
+};
+
+// A single producer, single consumer queue
+template <typename T>
+struct Ring {
+  auto push(T const* const items, std::size_t const count) -> std::size_t {
+    auto const end = tail.load(std::memory_order_relaxed);
+    auto const size = std::min(count, ringCapacity - (end - head.load()));
+    for (auto i = std::size_t {}; i < size; ++i) {
+      entries[(end + i) % ringCapacity] = items[i];
+    }
+    tail.store(end + size);
+    if (size != 0) {
+      readable.notify();
+    }
+    return size;
+  }
+
+  auto pop(T* const items, std::size_t const count) -> std::size_t {
+    auto const begin = head.load(std::memory_order_relaxed);
+    auto const size = std::min<std::size_t>(count, tail.load() - begin);
+    for (auto i = std::size_t {}; i < size; ++i) {
+      items[i] = entries[(begin + i) % ringCapacity];
+    }
+    head.store(begin + size);
+    if (size != 0) {
+      writable.notify();
+    }
+    return size;
+  }
+
+  // Discards every entry. Only safe once the other side is gone.
+  auto clear() -> void {
+    head.store(tail.load());
+    readable.sleeping.store(0);
+    writable.sleeping.store(0);
+  }
+
+  [[nodiscard]] auto empty() const -> bool {
+    return head.load() == tail.load();
+  }
+
+  [[nodiscard]] auto full() const -> bool {
+    return tail.load() - head.load() == ringCapacity;
+  }
+
+  // Written by the consumer
+  alignas(64) std::atomic<std::uint64_t> head {};
+  // Written by the producer
+  alignas(64) std::atomic<std::uint64_t> tail {};
+  alignas(64) Event readable;
+  alignas(64) Event writable;
+  std::array<T, ringCapacity> entries {};
+};
+
+struct Channel {
+  // The process id of the client using the channel, or 0 if it's unclaimed
+  alignas(64) std::atomic<std::uint32_t> owner {};
+  Ring<Request> requests;
+  Ring<double> responses;
+};
+
+struct alignas(alignof(Channel)) Segment {
+  [[nodiscard]] static auto size(std::size_t const channelCount)
+      -> std::size_t {
+    return sizeof(Segment) + channelCount * sizeof(Channel);
+  }
+
+  [[nodiscard]] auto channels() -> Channel* {
+    return reinterpret_cast<Channel*>(this + 1);
+  }
+
+  std::uint32_t magic {segmentMagic};
+  std::uint32_t channelCount {};
+  std::atomic<std::uint32_t> shutdown {};
+  // The process id of the server, or 0 while it's being set up
+  std::atomic<std::uint32_t> server {};
+  // Followed by channelCount channels
+};
+
+static_assert(sizeof(Segment) % alignof(Channel) == 0,
+              "Channels directly following the segment must be aligned");
+
+auto segment_name(string_view const name) -> string {
+  // POSIX shared memory names must start with a slash
+  return name.substr(0, 1) == "/" ? string {name} : "/" + string {name};
+}
+
+// returns true if pid is set but no such process exists, e.g. because it was
+// killed before it could clean up after itself
+auto is_dead(std::uint32_t const pid) -> bool {
+  return pid != 0 && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
+
+// returns true if the channel is claimed by a client that no longer exists
+auto abandoned(Channel const& channel) -> bool {
+  return is_dead(channel.owner.load());
+}
+
+// Removes the segment called segmentName if it was left behind by a server
+// that died. Segments being set up by a starting server are left alone.
+auto remove_stale(string const& segmentName) -> void {
+  auto const fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return;
+  }
+  struct stat status {};
+  auto const size = fstat(fd, &status) == 0
+                        ? static_cast<std::size_t>(status.st_size)
+                        : std::size_t {};
+  auto* const mapping = size < sizeof(Segment)
+                            ? MAP_FAILED
+                            : mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return;
+  }
+  auto const& segment = *static_cast<Segment const*>(mapping);
+  if (segment.magic == segmentMagic && is_dead(segment.server.load())) {
+    shm_unlink(segmentName.c_str());
+  }
+  munmap(mapping, size);
+}
+
+// Frees the channel of a client that died, dropping whatever it left in the
+// rings. Only called by the channel's worker, which is then the only process
+// using the rings.
+auto reclaim(Channel& channel) -> void {
+  channel.requests.clear();
+  channel.responses.clear();
+  channel.owner.store(0);
+}
+
+auto serve(Segment& segment, Channel& channel) -> void {
+  // Requests with invalid pair ids are converted between units of different
+  // types so that their results are NaN
+  auto const invalidPair = UnitPair {Unit {Unit::Temperature::celsius},
+                                     Unit {Unit::Distance::meter}};
+  auto requests = std::array<Request, batchSize> {};
+  auto pairs = std::array<UnitPair, batchSize> {};
+  auto values = std::array<double, batchSize> {};
+  auto results = std::array<double, batchSize> {};
+  auto converter = BatchConverter {};
+
+  while (segment.shutdown.load() == 0) {
+    auto const count = channel.requests.pop(requests.data(), requests.size());
+    if (count == 0) {
+      channel.requests.readable.wait([&] {
+        return !channel.requests.empty() || segment.shutdown.load() != 0;
+      });
+      if (channel.requests.empty() && abandoned(channel)) {
+        reclaim(channel);
+      }
+      continue;
+    }
+
+    for (auto i = std::size_t {}; i < count; ++i) {
+      auto const fromUnit = UnitId::fromBits(
+          static_cast<std::uint16_t>(requests[i].pairId >> 16U));
+      auto const toUnit = UnitId::fromBits(
+          static_cast<std::uint16_t>(requests[i].pairId & 0xFFFFU));
+      pairs[i] = fromUnit && toUnit ? UnitPair {*fromUnit, *toUnit}
+                                    : invalidPair;
+      values[i] = requests[i].value;
+    }
+    converter.convert(pairs.data(), values.data(), results.data(), nullptr,
+                      count);
+
+    auto sent = std::size_t {};
+    while (sent < count && segment.shutdown.load() == 0) {
+      sent += channel.responses.push(results.data() + sent, count - sent);
+      if (sent < count) {
+        channel.responses.writable.wait([&] {
+          return !channel.responses.full() || segment.shutdown.load() != 0;
+        });
+        if (channel.responses.full() && abandoned(channel)) {
+          reclaim(channel);
+          break;
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+auto serveSharedMemory(string_view const name, std::size_t const workerCount)
+    -> bool {
+  auto const segmentName = segment_name(name);
+  remove_stale(segmentName);
+  auto const fd =
+      shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    cerr << "[Shared memory] Could not create " << segmentName
+         << " (is a server already running?).\n";
+    return false;
+  }
+  auto const size = Segment::size(workerCount);
+  auto* const mapping =
+      ftruncate(fd, static_cast<off_t>(size)) == 0
+          ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    cerr << "[Shared memory] Could not map " << segmentName << ".\n";
+    shm_unlink(segmentName.c_str());
+    return false;
+  }
+
+  auto* const segment = new (mapping) Segment {};
+  segment->channelCount = static_cast<std::uint32_t>(workerCount);
+  for (auto i = std::size_t {}; i < workerCount; ++i) {
+    new (segment->channels() + i) Channel {};
+  }
+  segment->server.store(static_cast<std::uint32_t>(getpid()));
+
+  // The signals are handled by waiting for them below, so block them before
+  // the workers inherit the signal mask.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  auto workers = std::vector<std::thread> {};
+  for (auto i = std::size_t {}; i < workerCount; ++i) {
+    workers.emplace_back(serve, std::ref(*segment),
+                         std::ref(segment->channels()[i]));
+  }
+
+  auto signal = 0;
+  sigwait(&signals, &signal);
+
+  segment->shutdown.store(1);
+  for (auto i = std::size_t {}; i < workerCount; ++i) {
+    auto& channel = segment->channels()[i];
+    channel.requests.readable.notify(true);
+    channel.responses.writable.notify(true);
+    channel.responses.readable.notify(true);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  shm_unlink(segmentName.c_str());
+  munmap(mapping, size);
+  return true;
+}
+
+class SharedMemoryClient::Connection {
+public:
+  Connection(void* const mapping, std::size_t const size, Channel& channel)
+      : m_mapping {mapping}, m_size {size}, m_channel {channel} {}
+
+  Connection(Connection const&) = delete;
+  auto operator=(Connection const&) -> Connection& = delete;
+
+  ~Connection() {
+    m_channel.owner.store(0);
+    munmap(m_mapping, m_size);
+  }
+
+  [[nodiscard]] auto segment() const -> Segment& {
+    return *static_cast<Segment*>(m_mapping);
+  }
+
+  [[nodiscard]] auto channel() const -> Channel& { return m_channel; }
+
+private:
+  void* m_mapping;
+  std::size_t m_size;
+  Channel& m_channel;
+};
+
+auto SharedMemoryClient::connect(string_view const name)
+    -> std::optional<SharedMemoryClient> {
+  auto const segmentName = segment_name(name);
+  auto const fd = shm_open(segmentName.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    cerr << "[Shared memory] No server is running at " << segmentName
+         << ".\n";
+    return std::nullopt;
+  }
+  struct stat status {};
+  auto const size = fstat(fd, &status) == 0
+                        ? static_cast<std::size_t>(status.st_size)
+                        : std::size_t {};
+  auto* const mapping =
+      size < sizeof(Segment)
+          ? MAP_FAILED
+          : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    cerr << "[Shared memory] Could not map " << segmentName << ".\n";
+    return std::nullopt;
+  }
+
+  auto& segment = *static_cast<Segment*>(mapping);
+  if (segment.magic != segmentMagic ||
+      size < Segment::size(segment.channelCount)) {
+    cerr << "[Shared memory] " << segmentName << " is not a converter.\n";
+    munmap(mapping, size);
+    return std::nullopt;
+  }
+  if (is_dead(segment.server.load())) {
+    cerr << "[Shared memory] The server of " << segmentName << " died.\n";
+    munmap(mapping, size);
+    return std::nullopt;
+  }
+
+  // Channels of clients that died are reclaimed by their workers, which
+  // notice it within a sleep timeout once woken, so those are waited for.
+  auto const self = static_cast<std::uint32_t>(getpid());
+  for (auto attempt = 0; attempt < 10; ++attempt) {
+    auto anyAbandoned = false;
+    for (auto i = std::size_t {}; i < segment.channelCount; ++i) {
+      auto& channel = segment.channels()[i];
+      auto unclaimed = std::uint32_t {};
+      if (channel.owner.compare_exchange_strong(unclaimed, self)) {
+        return SharedMemoryClient {
+            std::make_unique<Connection>(mapping, size, channel)};
+      }
+      if (abandoned(channel)) {
+        anyAbandoned = true;
+        channel.requests.readable.notify(true);
+        channel.responses.writable.notify(true);
+      }
+    }
+    if (!anyAbandoned) {
+      break;
+    }
+    std::this_thread::sleep_for(sleepTimeout / 4);
+  }
+  cerr << "[Shared memory] Every channel of " << segmentName
+       << " is in use.\n";
+  munmap(mapping, size);
+  return std::nullopt;
+}
+
+auto SharedMemoryClient::convert(std::uint32_t const* const pairIds,
+                                 double const* const values,
+                                 double* const results, std::size_t const count)
+    -> bool {
+  auto& segment = m_connection->segment();
+  auto& channel = m_connection->channel();
+  auto requests = std::array<Request, batchSize> {};
+
+  // Responses are read while sending so that the worker never blocks on a
+  // full response ring while this blocks on a full request ring.
+  auto sent = std::size_t {};
+  auto received = std::size_t {};
+  auto serverDied = false;
+  while (received < count) {
+    if (serverDied || segment.shutdown.load() != 0) {
+      std::fill(results + received, results + count,
+                std::numeric_limits<double>::quiet_NaN());
+      return false;
+    }
+
+    auto pushed = std::size_t {};
+    if (sent < count) {
+      auto const batch = std::min(count - sent, requests.size());
+      for (auto i = std::size_t {}; i < batch; ++i) {
+        requests[i] = {pairIds[sent + i], values[sent + i]};
+      }
+      pushed = channel.requests.push(requests.data(), batch);
+      sent += pushed;
+    }
+
+    auto const popped =
+        channel.responses.pop(results + received, count - received);
+    received += popped;
+
+    if (pushed == 0 && popped == 0) {
+      auto const ready = [&] {
+        return !channel.responses.empty() ||
+               (sent < count && !channel.requests.full()) ||
+               segment.shutdown.load() != 0;
+      };
+      channel.responses.readable.wait(ready);
+      // A server that was killed never sets shutdown. Only checked once
+      // waiting timed out since it's a system call.
+      serverDied = !ready() && is_dead(segment.server.load());
+    }
+  }
+  return true;
+}
+
+#else
+
+auto serveSharedMemory(string_view const /*name*/,
+                       std::size_t const /*workerCount*/) -> bool {
+  cerr << "[Shared memory] Not supported on this platform.\n";
+  return false;
+}
+
+class SharedMemoryClient::Connection {};
+
+auto SharedMemoryClient::connect(string_view const /*name*/)
+    -> std::optional<SharedMemoryClient> {
+  cerr << "[Shared memory] Not supported on this platform.\n";
+  return std::nullopt;
+}
+
+auto SharedMemoryClient::convert(std::uint32_t const* const /*pairIds*/,
+                                 double const* const /*values*/,
+                                 double* const /*results*/,
+                                 std::size_t const /*count*/) -> bool {
+  return false;
+}
+
+#endif
+
+SharedMemoryClient::SharedMemoryClient(std::unique_ptr<Connection> connection)
+    : m_connection {std::move(connection)} {}
+
+SharedMemoryClient::SharedMemoryClient(SharedMemoryClient&& other) noexcept =
+    default;
+
+auto SharedMemoryClient::operator=(SharedMemoryClient&& other) noexcept
+    -> SharedMemoryClient& = default;
+
+SharedMemoryClient::~SharedMemoryClient() = default;
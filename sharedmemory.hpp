@@ -0,0 +1,56 @@
+#pragma once
+
+#include "logic.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+// Converting through shared memory lets processes on the same host convert
+// values without copying them through sockets or pipes. The server creates a
+// POSIX shared memory segment with one channel per worker thread. A client
+// claims a channel and writes batches of (unit pair, value) requests into its
+// lock-free request ring, and the channel's worker writes the results into
+// the response ring in the same order. Either side only sleeps (on a futex on
+// Linux) when its ring has been empty for a while. A channel left claimed by a
+// client that died is reclaimed by its worker.
+
+// Identifies a pair of built-in units in shared memory requests: the bits of
+// fromUnit's UnitId in the high half and toUnit's in the low half.
+// returns empty optional if units are of different types (e.g. distance and
+// temperature)
+[[nodiscard]] auto sharedPairId(UnitId fromUnit, UnitId toUnit)
+    -> std::optional<std::uint32_t>;
+
+// Serves conversions in the shared memory segment called name with
+// workerCount threads until the process receives SIGINT or SIGTERM.
+// returns false and reports the error if the segment can't be created
+auto serveSharedMemory(std::string_view name, std::size_t workerCount) -> bool;
+
+class SharedMemoryClient {
+public:
+  // returns empty optional and reports the error if there's no server or all
+  // of its channels are in use
+  [[nodiscard]] static auto connect(std::string_view name)
+      -> std::optional<SharedMemoryClient>;
+
+  SharedMemoryClient(SharedMemoryClient&& other) noexcept;
+  auto operator=(SharedMemoryClient&& other) noexcept -> SharedMemoryClient&;
+  ~SharedMemoryClient();
+
+  // Converts values[i] between the units of pairIds[i] into results[i], or
+  // NaN if pairIds[i] isn't a valid pair.
+  // returns false if the server shut down or died before every value was
+  // converted
+  auto convert(std::uint32_t const* pairIds, double const* values,
+               double* results, std::size_t count) -> bool;
+
+private:
+  class Connection;
+
+  explicit SharedMemoryClient(std::unique_ptr<Connection> connection);
+
+  std::unique_ptr<Connection> m_connection;
+};
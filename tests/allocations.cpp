@@ -0,0 +1,86 @@
+// Checks that the string conversion functions don't allocate once the
+// built-in unit table exists, by counting the calls to the global operator
+// new while they run.
+
+#include "../convertfromstrings.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string_view>
+
+namespace {
+
+std::atomic<bool> counting {false};
+std::atomic<std::size_t> allocations {0};
+
+auto allocate(std::size_t const size) -> void* {
+  if (counting) {
+    ++allocations;
+  }
+  if (auto* const memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc {};
+}
+
+} // namespace
+
+auto operator new(std::size_t const size) -> void* { return allocate(size); }
+auto operator new[](std::size_t const size) -> void* { return allocate(size); }
+auto operator delete(void* const memory) noexcept -> void { std::free(memory); }
+auto operator delete[](void* const memory) noexcept -> void {
+  std::free(memory);
+}
+auto operator delete(void* const memory, std::size_t /*unused*/) noexcept
+    -> void {
+  std::free(memory);
+}
+auto operator delete[](void* const memory, std::size_t /*unused*/) noexcept
+    -> void {
+  std::free(memory);
+}
+
+auto main() -> int {
+  using namespace std::string_view_literals;
+
+  auto const definitionPath =
+      std::filesystem::temp_directory_path() / "jconverter-allocations.units";
+  std::ofstream {definitionPath} << "smoot 1.7018 meter\n";
+  if (!loadCustomUnits(definitionPath)) {
+    return EXIT_FAILURE;
+  }
+
+  auto const run = [] {
+    auto sum = 0.;
+    for (auto i = 0; i < 1000; ++i) {
+      sum += *convert("Kilometers"sv, "mile"sv, "12.5"sv);
+      sum += *convert("c"sv, "F"sv, 100.);
+      sum += *convert("smoot"sv, "feet"sv, 1.);
+      sum += conversion("lb"sv, "kg"sv)->scale;
+      sum += *parseValue("1.234,5"sv, NumberFormat {',', '.'});
+      sum += stringToUnit("not a unit"sv) ? 1. : 0.;
+    }
+    return sum;
+  };
+
+  // Builds the built-in unit table
+  auto const expected = run();
+  counting = true;
+  auto const actual = run();
+  counting = false;
+
+  std::filesystem::remove(definitionPath);
+  std::filesystem::remove(definitionPath.string() + ".cache");
+
+  if (allocations != 0 || actual != expected) {
+    std::cerr << "String conversions allocated " << allocations
+              << " times.\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}